@@ -0,0 +1,212 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include "neuropia.h"
+#include "trainer.h"
+#include "paralleltrain.h"
+#include "evotrain.h"
+#include "verify.h"
+#include "params.h"
+#include "argparse.h"
+#include "default.h"
+#include "utils.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+struct Case {
+    std::string trainer;
+    std::string topology;
+    unsigned jobs;
+    unsigned iterations;
+    unsigned batchSize;
+    unsigned testFrequency;
+};
+
+struct Result {
+    size_t samples;
+    double seconds;
+    double timeToTarget; // negative if target was not reached
+    double accuracy;
+    long peakRss;        // kB, negative if not available
+};
+
+// Trainer iterations are samples, parallel and evo iterations are rounds of Jobs * BatchSize samples
+const std::vector<Case> Cases = {
+    {"trainer",  "32,16",  1, 10000, 0, 500},
+    {"trainer",  "64,32",  1, 10000, 0, 500},
+    {"trainer",  "128,64", 1, 10000, 0, 500},
+    {"parallel", "64,32",  1, 20, 500, 1},
+    {"parallel", "64,32",  2, 20, 500, 1},
+    {"parallel", "64,32",  4, 20, 500, 1},
+    {"evo",      "64,32",  2, 20, 500, 1},
+    {"evo",      "64,32",  4, 20, 500, 1},
+};
+
+std::string caseName(const Case& c) {
+    return c.trainer + "_" + c.topology + "_j" + std::to_string(c.jobs);
+}
+
+// peak memory is reset per case where possible, elsewhere it is the process peak
+void resetPeakRss() {
+#if defined(__linux__)
+    std::ofstream clear("/proc/self/clear_refs");
+    clear << "5";
+#endif
+}
+
+long peakRss() {
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line)) {
+        if(line.rfind("VmHWM:", 0) == 0) {
+            return std::stol(line.substr(6));
+        }
+    }
+    return -1;
+#elif defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return -1;
+#endif
+}
+
+std::unique_ptr<Neuropia::TrainerBase> makeTrainer(const Case& c, const std::string& root, const Neuropia::Params& params) {
+    if(c.trainer == "parallel")
+        return std::make_unique<Neuropia::TrainerParallel>(root, params, true);
+    if(c.trainer == "evo")
+        return std::make_unique<Neuropia::TrainerEvo>(root, params, true);
+    return std::make_unique<Neuropia::Trainer>(root, params, true);
+}
+
+std::optional<Result> run(const Case& c, const std::string& root, Neuropia::Params params, const std::string& target) {
+    params.set("Topology", c.topology);
+    params.set("Jobs", std::to_string(c.jobs));
+    params.set("Iterations", std::to_string(c.iterations));
+    if(c.batchSize > 0)
+        params.set("BatchSize", std::to_string(c.batchSize));
+    params.set("TestFrequency", std::to_string(c.testFrequency));
+    params.set("TargetAccuracy", target);
+
+    resetPeakRss();
+    auto trainer = makeTrainer(c, root, params);
+    if(!trainer->init())
+        return std::nullopt;
+    const auto start = std::chrono::high_resolution_clock::now();
+    if(!trainer->train())
+        return std::nullopt;
+    const auto stop = std::chrono::high_resolution_clock::now();
+
+    const auto network = trainer->network();
+    const auto [found, count] = Neuropia::verify(network,
+                                   Neuropia::absPath(root, params["ImagesVerify"]),
+                                   Neuropia::absPath(root, params["LabelsVerify"]), true);
+    const auto reached = trainer->targetReached();
+    const auto seconds = [](auto from, auto to) {return std::chrono::duration<double>(to - from).count();};
+    return Result{
+        trainer->trainedSamples(),
+        seconds(start, stop),
+        reached ? seconds(start, *reached) : -1.0,
+        count > 0 ? static_cast<double>(found) / static_cast<double>(count) : 0.0,
+        peakRss()};
+}
+
+std::string toJson(const Case& c, const Result& r) {
+    std::ostringstream out;
+    out.precision(6);
+    out << std::fixed;
+    out << "    {\"name\": \"" << caseName(c) << "\""
+        << ", \"trainer\": \"" << c.trainer << "\""
+        << ", \"topology\": \"" << c.topology << "\""
+        << ", \"jobs\": " << c.jobs
+        << ", \"iterations\": " << c.iterations
+        << ", \"samples\": " << r.samples
+        << ", \"seconds\": " << r.seconds
+        << ", \"samples_per_sec\": " << (r.seconds > 0 ? static_cast<double>(r.samples) / r.seconds : 0.0)
+        << ", \"time_to_target\": ";
+    if(r.timeToTarget >= 0)
+        out << r.timeToTarget;
+    else
+        out << "null";
+    out << ", \"accuracy\": " << r.accuracy
+        << ", \"peak_rss_kb\": ";
+    if(r.peakRss >= 0)
+        out << r.peakRss;
+    else
+        out << "null";
+    out << "}";
+    return out.str();
+}
+}
+
+int main(int argc, char* argv[]) {
+    ArgParse argparse;
+    argparse
+            .addOpt('r', "root", true, NEUROPIA_BENCH_DATA)
+            .addOpt('o', "output", true, "bench.json")
+            .addOpt('t', "target", true, "0.9")
+            .addOpt('f', "filter", true, "");
+
+    if(!argparse.set(argc, argv)) {
+        std::cerr << "neuropia_bench [-r MNIST_DIR] [-o OUTPUT.json] [-t TARGET_ACCURACY] [-f CASE_FILTER]" << std::endl;
+        return -1;
+    }
+
+    Neuropia::Params params = {
+        DEFAULT_PARAMS
+    };
+
+    params.set("Classes", "10");
+    params.set("Images", "train-images-idx3-ubyte");
+    params.set("Labels", "train-labels-idx1-ubyte");
+    params.set("ImagesVerify", "t10k-images-idx3-ubyte");
+    params.set("LabelsVerify", "t10k-labels-idx1-ubyte");
+
+    const auto root = argparse.option('r');
+    const auto target = argparse.option('t');
+    const auto filter = argparse.option('f');
+
+    std::vector<std::string> results;
+    for(const auto& c : Cases) {
+        const auto name = caseName(c);
+        if(!filter.empty() && name.find(filter) == std::string::npos)
+            continue;
+        std::cerr << name << "..." << std::endl;
+        const auto result = run(c, root, params, target);
+        if(!result) {
+            std::cerr << name << " failed" << std::endl;
+            return 1;
+        }
+        std::cerr << name << " " << static_cast<double>(result->samples) / result->seconds << " samples/s" << std::endl;
+        results.push_back(toJson(c, *result));
+    }
+
+    std::ofstream out(argparse.option('o'));
+    if(!out) {
+        std::cerr << "Cannot write " << argparse.option('o') << std::endl;
+        return 1;
+    }
+    out << "{\n  \"seed\": " << RANDOM_SEED << ",\n  \"target\": " << target << ",\n  \"cases\": [\n";
+    for(auto i = 0U; i < results.size(); i++) {
+        out << results[i] << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return 0;
+}
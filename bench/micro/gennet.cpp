@@ -0,0 +1,16 @@
+#include <iostream>
+#include "neuropia.h"
+#include "utils.h"
+
+// Generates a random float network that microbench compiles in for the Feed benchmark
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        std::cerr << "Expect OUTPUT" << std::endl;
+        return 1;
+    }
+    Neuropia::Layer network(784);
+    network.join({64, 32, 10});
+    network.randomize();
+    Neuropia::save(argv[1], network, {{"Topology", "64,32"}}, Neuropia::SaveType::Float);
+    return 0;
+}
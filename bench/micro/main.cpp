@@ -0,0 +1,316 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <filesystem>
+#include "neuropia.h"
+#include "neuropia_feed.h"
+#include "neuropia_binary.h"
+#include "threadpool.h"
+#include "neuropialib.h"
+#include "idxreader.h"
+#include "matrix.h"
+#include "argparse.h"
+#include "utils.h"
+#include "perfcounters.h"
+#include "neuropia_bench_net.h"
+
+// Global allocation counters, all allocations of the process go through these
+namespace {
+std::atomic<size_t> g_allocations{0};
+std::atomic<size_t> g_allocatedBytes{0};
+
+void* countedAlloc(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if(void* ptr = std::malloc(size > 0 ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+}
+
+void* operator new(size_t size) {return countedAlloc(size);}
+void* operator new[](size_t size) {return countedAlloc(size);}
+void operator delete(void* ptr) noexcept {std::free(ptr);}
+void operator delete[](void* ptr) noexcept {std::free(ptr);}
+void operator delete(void* ptr, size_t) noexcept {std::free(ptr);}
+void operator delete[](void* ptr, size_t) noexcept {std::free(ptr);}
+
+namespace {
+
+using NeuropiaFeed = Neuropia::Feed<neuropia_bench_net, sizeof(neuropia_bench_net)>;
+
+struct Measure {
+    std::string name;
+    double nsPerOp;
+    double bytesPerOp;
+    double allocsPerOp;
+    Neuropia::PerfCounters::Counts counters; // zero if not sampled
+    double rounds;
+};
+
+volatile double g_sink = 0; // keeps results alive
+
+class MicroBench {
+public:
+    MicroBench(double minTime, const std::string& filter, bool counters) : m_minTime(minTime), m_filter(filter),
+        m_counters(counters && Neuropia::PerfCounters::thread().available()) {}
+
+    template<typename F>
+    void run(const std::string& name, F&& f) {
+        if(!m_filter.empty() && name.find(m_filter) == std::string::npos)
+            return;
+        // warm up and find out how many rounds fit in the measurement time
+        size_t rounds = 1;
+        for(;;) {
+            const auto elapsed = time(f, rounds);
+            if(elapsed >= m_minTime / 10 || rounds >= (1U << 30)) {
+                rounds = std::max<size_t>(1, static_cast<size_t>(static_cast<double>(rounds) * m_minTime / std::max(elapsed, 1e-9)));
+                break;
+            }
+            rounds *= 2;
+        }
+        auto& counters = Neuropia::PerfCounters::thread();
+        const auto allocations = g_allocations.load();
+        const auto bytes = g_allocatedBytes.load();
+        const auto counts = m_counters ? counters.read() : Neuropia::PerfCounters::Counts{0, 0, 0, 0};
+        const auto elapsed = time(f, rounds);
+        const auto n = static_cast<double>(rounds);
+        m_results.push_back({name, elapsed * 1e9 / n,
+                             static_cast<double>(g_allocatedBytes.load() - bytes) / n,
+                             static_cast<double>(g_allocations.load() - allocations) / n,
+                             m_counters ? counters.read() - counts : counts, n});
+        const auto& r = m_results.back();
+        std::cout << std::left << std::setw(32) << r.name << std::right
+                  << std::setw(14) << std::fixed << std::setprecision(1) << r.nsPerOp << " ns/op"
+                  << std::setw(12) << r.bytesPerOp << " B/op"
+                  << std::setw(10) << std::setprecision(2) << r.allocsPerOp << " allocs/op";
+        if(m_counters) {
+            std::cout << std::setw(8) << ipc(r) << " IPC"
+                      << std::setw(10) << std::setprecision(1) << static_cast<double>(r.counters.cacheMisses) / n << " cache-misses/op"
+                      << std::setw(10) << static_cast<double>(r.counters.branchMisses) / n << " branch-misses/op";
+        }
+        std::cout << std::endl;
+    }
+
+    bool write(const std::string& filename) const {
+        std::ofstream out(filename);
+        if(!out)
+            return false;
+        out << "{\n  \"cases\": [\n";
+        for(auto i = 0U; i < m_results.size(); i++) {
+            const auto& r = m_results[i];
+            out << "    {\"name\": \"" << r.name << "\", \"ns_per_op\": " << r.nsPerOp
+                << ", \"bytes_per_op\": " << r.bytesPerOp << ", \"allocs_per_op\": " << r.allocsPerOp;
+            if(m_counters) {
+                out << ", \"ipc\": " << ipc(r)
+                    << ", \"cache_misses_per_op\": " << static_cast<double>(r.counters.cacheMisses) / r.rounds
+                    << ", \"branch_misses_per_op\": " << static_cast<double>(r.counters.branchMisses) / r.rounds;
+            }
+            out << "}" << (i + 1 < m_results.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+        return true;
+    }
+
+private:
+    static double ipc(const Measure& r) {
+        return r.counters.cycles > 0 ? static_cast<double>(r.counters.instructions) / static_cast<double>(r.counters.cycles) : 0.0;
+    }
+
+    template<typename F>
+    static double time(F& f, size_t rounds) {
+        double sum = 0;
+        const auto start = std::chrono::high_resolution_clock::now();
+        for(size_t i = 0; i < rounds; i++) {
+            sum += static_cast<double>(f());
+        }
+        const auto stop = std::chrono::high_resolution_clock::now();
+        g_sink = g_sink + sum;
+        return std::chrono::duration<double>(stop - start).count();
+    }
+
+private:
+    const double m_minTime;
+    const std::string m_filter;
+    const bool m_counters;
+    std::vector<Measure> m_results = {};
+};
+
+template<typename T>
+std::vector<T> randomValues(size_t count) {
+    std::vector<T> values(count);
+    std::default_random_engine gen(RANDOM_SEED);
+    std::uniform_real_distribution<double> dist(0, 1);
+    for(auto& v : values)
+        v = static_cast<T>(dist(gen));
+    return values;
+}
+
+std::vector<uint8_t> randomBytes(size_t count) {
+    std::vector<uint8_t> values(count);
+    std::default_random_engine gen(RANDOM_SEED);
+    std::uniform_int_distribution<unsigned> dist(0, 255);
+    for(auto& v : values)
+        v = static_cast<uint8_t>(dist(gen));
+    return values;
+}
+
+Neuropia::Layer makeNetwork(int inputs, const std::vector<int>& topology) {
+    Neuropia::Layer network(static_cast<size_t>(inputs));
+    network.join(topology.begin(), topology.end());
+    network.randomize();
+    return network;
+}
+
+std::vector<uint8_t> readBytes(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// IDX file of count 28x28 byte images
+bool writeIdx(const std::string& filename, uint32_t count) {
+    std::ofstream file(filename, std::ios::binary);
+    const auto be32 = [&file](uint32_t v) {
+        const char bytes[] = {static_cast<char>(v >> 24), static_cast<char>(v >> 16), static_cast<char>(v >> 8), static_cast<char>(v)};
+        file.write(bytes, sizeof(bytes));
+    };
+    file.put(0).put(0).put(0x08).put(3);
+    be32(count);
+    be32(28);
+    be32(28);
+    const auto values = randomValues<double>(static_cast<size_t>(count) * 28 * 28);
+    for(const auto v : values)
+        file.put(static_cast<char>(v * 255));
+    return file.good();
+}
+}
+
+int main(int argc, char* argv[]) {
+    ArgParse argparse;
+    argparse
+            .addOpt('o', "output", true, "")
+            .addOpt('t', "time", true, "0.2")
+            .addOpt('f', "filter", true, "")
+            .addOpt('c', "counters");
+
+    if(!argparse.set(argc, argv)) {
+        std::cerr << "neuropia_microbench [-o OUTPUT.json] [-t SECONDS_PER_CASE] [-f CASE_FILTER] [-c]" << std::endl;
+        std::cerr << "-c samples hardware performance counters" << std::endl;
+        return -1;
+    }
+
+    MicroBench bench(std::stod(argparse.option('t')), argparse.option('f'), argparse.hasOption('c'));
+
+    using Mat = Neuropia::Matrix<Neuropia::NeuronType>;
+    for(const auto n : {16U, 64U, 256U}) {
+        const auto s = std::to_string(n);
+        Mat a(n, n);
+        Mat b(n, n);
+        a.randomize();
+        b.randomize();
+        bench.run("matrix_multiply_" + s, [&]() {return a.multiply(b)(0, 0);});
+        bench.run("matrix_transpose_" + s, [&]() {return a.transpose()(0, 0);});
+        bench.run("matrix_map_" + s, [&]() {return a.map([](const auto& v) noexcept {return v * 2;})(0, 0);});
+    }
+
+    for(const auto width : {32, 128, 784}) {
+        const auto s = std::to_string(width);
+        const auto inputs = randomValues<Neuropia::NeuronType>(static_cast<size_t>(width));
+        const Neuropia::Neuron neuron(Neuropia::sigmoidFunction, randomValues<Neuropia::NeuronType>(static_cast<size_t>(width)), 0.5);
+        bench.run("neuron_feed_" + s, [&]() {return neuron.feed(inputs.begin(), inputs.end());});
+    }
+
+    Neuropia::ThreadPool pool;
+    for(const auto width : {32, 128, 512}) {
+        const auto s = std::to_string(width);
+        auto network = makeNetwork(784, {width, width / 2, 10});
+        const auto inputs = randomValues<Neuropia::NeuronType>(784);
+        const auto bytes = randomBytes(784);
+        auto sparse = inputs;  // about 80% zeros as in MNIST images
+        for(size_t i = 0; i < sparse.size(); i++) {
+            if(bytes[i] < 204)
+                sparse[i] = 0;
+        }
+        const Neuropia::ValueVector expected = {0, 0, 0, 1, 0, 0, 0, 0, 0, 0};
+        bench.run("layer_feed_" + s, [&]() {return network.feed(inputs.begin(), inputs.end())[0];});
+        bench.run("layer_feed_bytes_" + s, [&]() {return network.feed(bytes.begin(), bytes.end(), Neuropia::ByteScale)[0];});
+        bench.run("layer_feed_parallel_" + s, [&]() {return network.feed(inputs.begin(), inputs.end(), pool)[0];});
+        bench.run("layer_feed_sparse_" + s, [&]() {return network.feed(sparse.begin(), sparse.end())[0];});
+        auto pruned = network;
+        pruned.prune(0.9);
+        bench.run("layer_feed_pruned_" + s, [&]() {return pruned.feed(inputs.begin(), inputs.end())[0];});
+        auto factorized = network;
+        factorized.get(1)->factorize(static_cast<size_t>(width / 4));
+        bench.run("layer_feed_factorized_" + s, [&]() {return factorized.feed(inputs.begin(), inputs.end())[0];});
+        const auto binary = Neuropia::BinaryNetwork::convert(network);
+        bench.run("binary_feed_" + s, [&]() {return binary->feed(bytes.begin(), bytes.end())[0];});
+        auto layerCopy = network;
+        bench.run("layer_copy_" + s, [&]() {layerCopy = network; return layerCopy.get(1)->size();});
+        auto adam = network;
+        adam.setOptimizer(Neuropia::Optimizer(Neuropia::Optimizer::Type::Adam, 0.9, 0.999));
+        adam.train(inputs.begin(), expected.begin(), 0.01, 0.0);
+        bench.run("layer_copy_adam_" + s, [&]() {layerCopy = adam; return layerCopy.get(1)->size();});
+        bench.run("layer_copy_pruned_" + s, [&]() {layerCopy = pruned; return layerCopy.get(1)->size();});
+        bench.run("layer_train_" + s, [&]() {return network.train(inputs.begin(), expected.begin(), 0.01, 0.0);});
+        bench.run("layer_train_sparse_" + s, [&]() {return network.train(sparse.begin(), expected.begin(), 0.01, 0.0);});
+#ifndef STD_ALLOCATOR
+        bench.run("layer_train_arena_" + s, [&]() {
+            const Neuropia::MatrixArena::Scope arena;
+            return network.train(inputs.begin(), expected.begin(), 0.01, 0.0);
+        });
+#endif
+    }
+
+    const auto temp = std::filesystem::temp_directory_path();
+    const auto netFile = (temp / "neuropia_microbench.bin").string();
+    Neuropia::save(netFile, makeNetwork(784, {128, 64, 10}));
+    const auto bytes = readBytes(netFile);
+    std::filesystem::remove(netFile);
+    bench.run("layer_load", [&]() {
+        Neuropia::Layer network;
+        return network.load(bytes).has_value();
+    });
+
+    const auto idxFile = (temp / "neuropia_microbench.idx").string();
+    constexpr auto IdxCount = 1000U;
+    if(writeIdx(idxFile, IdxCount)) {
+        Neuropia::IdxReader<std::array<unsigned char, 28 * 28>> images(idxFile);
+        Neuropia::IdxReader<unsigned char> bytesReader(idxFile);
+        size_t pos = 0;
+        bench.run("idx_read_at_image", [&]() {
+            pos = (pos * 7 + 13) % IdxCount;
+            return images.readAt(pos)[0];
+        });
+        bench.run("idx_read_at_byte", [&]() {
+            pos = (pos * 7 + 13) % IdxCount;
+            return bytesReader.readAt(pos);
+        });
+    } else {
+        std::cerr << "Cannot write " << idxFile << ", idx cases skipped" << std::endl;
+    }
+    std::filesystem::remove(idxFile);
+
+    const auto floats = randomValues<float>(NeuropiaFeed::in_layer_size());
+    bench.run("feed_feed", [&]() {return NeuropiaFeed::feed(floats.begin(), floats.end())[0];});
+    const auto feedBytes = randomBytes(NeuropiaFeed::in_layer_size());
+    bench.run("feed_feed_bytes", [&]() {return NeuropiaFeed::feed(feedBytes.begin(), feedBytes.end(), 1.0f / 255.0f)[0];});
+    Neuropia::Network lib;
+    if(lib.load(neuropia_bench_net, sizeof(neuropia_bench_net))) {
+        const auto inputs = randomValues<Neuropia::NeuronType>(NeuropiaFeed::in_layer_size());
+        bench.run("network_feed", [&]() {return lib.feed(inputs.begin(), inputs.end())[0];});
+    }
+
+    const auto output = argparse.option('o');
+    if(!output.empty() && !bench.write(output)) {
+        std::cerr << "Cannot write " << output << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "argparse.h"
+#include "utils.h"
+#include "verify.h"
+#include "neuropia_binary.h"
+#include <iostream>
+#include <filesystem>
+
+
+int main(int argc, char* argv[]) {
+
+    ArgParse argparse;
+    argparse.addOpt('t', "threshold", true, "128");
+
+    if(!argparse.set(argc, argv)) {
+        std::cerr << "Invalid args" << std::endl;
+        return -1;
+    }
+
+    if(argparse.paramCount() < 3) {
+        std::cerr << "neuropia_binarize <--threshold THRESHOLD> NETWORK_FILE OUTPUT <IMAGES> <LABELS>" << std::endl;
+        std::cerr << "Converts a network to a binarized network of sign bit weights and activations. Hidden layers have to be" << std::endl;
+        std::cerr << "signumFunction, binaryFunction or sigmoidFunction. Input bytes at or above THRESHOLD (default 128) are 1, else 0." << std::endl;
+        std::cerr << "If IMAGES and LABELS are given, accuracy of both networks is verified." << std::endl;
+        return 1;
+    }
+
+    const auto threshold = std::atoi(argparse.option("threshold").c_str());
+    if(threshold < 0 || threshold > 255) {
+        std::cerr << "Bad THRESHOLD, expected 0 - 255" << std::endl;
+        return 1;
+    }
+
+    const auto loaded = Neuropia::load(argparse.param(1));
+    if(!loaded) {
+        return 2;
+    }
+    const auto& network = std::get<0>(*loaded);
+
+    const auto binary = Neuropia::BinaryNetwork::convert(network, static_cast<uint8_t>(threshold));
+    if(!binary) {
+        return 3;
+    }
+    if(!binary->save(argparse.param(2))) {
+        return 2;
+    }
+
+    std::cout << "bytes: " << std::filesystem::file_size(argparse.param(1)) << " -> " << std::filesystem::file_size(argparse.param(2)) << std::endl;
+
+    if(argparse.paramCount() > 4) {
+        const auto& imageFile = argparse.param(3);
+        const auto& labelFile = argparse.param(4);
+        const auto [found, total] = Neuropia::verify(network, imageFile, labelFile, true);
+        Neuropia::IdxReader<unsigned char> images(imageFile);
+        Neuropia::IdxReader<unsigned char> labels(labelFile);
+        const auto imageSize = images.size(1) * images.size(2);
+        if(!images.ok() || !labels.ok() || imageSize != binary->inSize()) {
+            std::cerr << "Cannot verify with " << imageFile << " and " << labelFile << std::endl;
+            return 2;
+        }
+        unsigned binaryFound = 0;
+        Neuropia::timed([&]() {
+            for(size_t i = 0; i < labels.size(); i++) {
+                const auto image = images.read(imageSize);
+                const auto label = static_cast<unsigned>(labels.read());
+                const auto& outputs = binary->feed(image.begin(), image.end());
+                if(static_cast<unsigned>(std::distance(outputs.begin(), std::max_element(outputs.begin(), outputs.end()))) == label)
+                    ++binaryFound;
+            }
+        }, "Binary verify");
+        Neuropia::printVerify({static_cast<size_t>(found), total}, "Network");
+        Neuropia::printVerify({binaryFound, labels.size()}, "Binary");
+    }
+    return 0;
+}
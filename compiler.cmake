@@ -4,6 +4,8 @@ function (SET_COMPILER_FLAGS)
         target_compile_options(${PROJECT_NAME} PRIVATE /W4 /WX)
     else()
         target_compile_options(${PROJECT_NAME} PRIVATE -Wall -Wextra -Wpedantic -Werror)
+        # errno is not used, without this loops calling sqrt are not vectorized
+        target_compile_options(${PROJECT_NAME} PRIVATE -fno-math-errno)
     endif()
 
     target_compile_features(${PROJECT_NAME} PRIVATE cxx_std_17)
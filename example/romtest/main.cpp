@@ -54,16 +54,12 @@ int main(int argc, char* argv[]) {
     int found = 0;
     Neuropia::timed([&]() {
         const auto imageSize = testImages.size(1) * testImages.size(2);
-        std::vector<Neuropia::NeuronType> inputs(imageSize);
         const auto iterations = testLabels.size();
         for(auto i = 0U; i < iterations; i++) {
             const auto image = testImages.read(imageSize);
             const auto label = static_cast<unsigned>(testLabels.read());
 
-            std::transform(image.begin(), image.end(), inputs.begin(), [](unsigned char c) {
-                return Neuropia::normalize(static_cast<Neuropia::NeuronType>(c), 0, 255);
-            });
-            const auto outputs = NeuropiaFeed::feed(inputs.begin(), inputs.end());
+            const auto outputs = NeuropiaFeed::feed(image.begin(), image.end(), static_cast<float>(Neuropia::ByteScale));
             const auto max = static_cast<unsigned>(std::distance(outputs.begin(),
                                                  std::max_element(outputs.begin(), outputs.end())));
 
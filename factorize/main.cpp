@@ -0,0 +1,106 @@
+#include "argparse.h"
+#include "utils.h"
+#include "verify.h"
+#include <iostream>
+#include <filesystem>
+
+
+int main(int argc, char* argv[]) {
+
+    ArgParse argparse;
+    argparse.addOpt('d', "data_type", true, "double");
+    argparse.addOpt('l', "layer", true, "1");
+
+    if(!argparse.set(argc, argv)) {
+        std::cerr << "Invalid args" << std::endl;
+        return -1;
+    }
+
+    if(argparse.paramCount() < 6) {
+        std::cerr << "neuropia_factorize <--data_type <double|float|longDouble>> <--layer LAYER> NETWORK_FILE OUTPUT IMAGES LABELS MAX_LOSS" << std::endl;
+        std::cerr << "Replaces weights of LAYER (default 1, the first after input) with a product of two smaller matrices by truncated SVD." << std::endl;
+        std::cerr << "The smallest rank that loses at most MAX_LOSS (0 - 1) of the accuracy on IMAGES and LABELS is used." << std::endl;
+        std::cerr << "To fine-tune after factorization, train with Rank parameter instead." << std::endl;
+        return 1;
+    }
+
+    Neuropia::SaveType save_type = Neuropia::SaveType::SameAsNeuronType;
+
+    if(argparse.hasOption("data_type")) {
+        if(argparse.option("data_type") == "double")
+            save_type = Neuropia::SaveType::Double;
+        else if(argparse.option("data_type") == "float")
+            save_type = Neuropia::SaveType::Float;
+        else if(argparse.option("data_type") == "longDouble")
+            save_type = Neuropia::SaveType::LongDouble;
+        else {
+            std::cerr << "Bad data type --data_type <double|float|longDouble>" << std::endl;
+            return 1;
+        }
+    }
+
+    const auto maxLoss = std::atof(argparse.param(5).c_str());
+    if(maxLoss < 0.0 || maxLoss >= 1.0) {
+        std::cerr << "Bad MAX_LOSS, expected 0 <= MAX_LOSS < 1" << std::endl;
+        return 1;
+    }
+
+    auto loaded = Neuropia::load(argparse.param(1));
+    if(!loaded) {
+        return 2;
+    }
+    auto& [network, meta] = *loaded;
+
+    const auto layer = std::atoi(argparse.option("layer").c_str());
+    if(layer < 1 || network.get(layer) == nullptr) {
+        std::cerr << "Bad LAYER" << std::endl;
+        return 1;
+    }
+
+    const auto& images = argparse.param(3);
+    const auto& labels = argparse.param(4);
+    const auto accuracy = [&images, &labels](const Neuropia::Layer& net) {
+        const auto [found, total] = Neuropia::verify(net, images, labels, true);
+        return total > 0 ? static_cast<double>(found) / static_cast<double>(total) : 0.0;
+    };
+
+    const auto base = accuracy(network);
+    const auto inputs = network.get(layer - 1)->size();
+    const auto outputs = network.get(layer)->size();
+    // factorization pays off only below the rank where both stages together are as large as the original
+    const auto maxRank = std::min((inputs * outputs) / (inputs + outputs), std::min(inputs, outputs));
+    const auto factorized = [&network, layer](size_t rank) {
+        Neuropia::Layer copy(network);
+        copy.get(layer)->factorize(rank);
+        return copy;
+    };
+
+    // accuracy is assumed to grow with the rank, hence the smallest rank within budget is searched by bisection
+    size_t low = 1;
+    size_t high = maxRank;
+    std::optional<Neuropia::Layer> best;
+    double bestAccuracy = 0;
+    while(low <= high && high > 0) {
+        const auto rank = (low + high) / 2;
+        auto candidate = factorized(rank);
+        const auto a = accuracy(candidate);
+        std::cout << "rank:" << rank << " accuracy:" << a << std::endl;
+        if(base - a <= maxLoss) {
+            best = std::move(candidate);
+            bestAccuracy = a;
+            high = rank - 1;
+        } else {
+            low = rank + 1;
+        }
+    }
+
+    if(!best) {
+        std::cerr << "No rank below " << maxRank << " is within MAX_LOSS, accuracy:" << base << std::endl;
+        return 3;
+    }
+
+    Neuropia::save(argparse.param(2), *best, meta, save_type);
+    std::cout << "L:" << layer << " rank:" << best->get(layer)->size() << " accuracy: " << base << " -> " << bestAccuracy << std::endl;
+    std::cout << "bytes: " << std::filesystem::file_size(argparse.param(1)) << " -> " << std::filesystem::file_size(argparse.param(2)) << std::endl;
+    return 0;
+}
@@ -4,6 +4,7 @@
 constexpr char topologyRe[] = R"(\d+(,\d+)*$)";
 constexpr char activationFunctionRe[] =R"((sigmoid|relu|elu)(,(sigmoid|relu|elu))*$)";
 constexpr char dropoutRateRe[] = R"(\d+\.?\d*(,\d+\.?\d*)*$)";
+constexpr char freezeRe[] = R"([01](,[01])*$)";
 
 #define DEFAULT_PARAMS \
 {"ImagesVerify", "", Neuropia::Params::File}, \
@@ -21,12 +22,40 @@ constexpr char dropoutRateRe[] = R"(\d+\.?\d*(,\d+\.?\d*)*$)";
 {"MaxTrainTime", std::to_string(static_cast<int>(Neuropia::MaxTrainTime)), Neuropia::Params::Int}, \
 {"File", "", Neuropia::Params::File}, \
 {"Extra", "", Neuropia::Params::String}, \
-{"Hard", "false", Neuropia::Params::Bool}, \
+{"Hard", "true", Neuropia::Params::Bool}, \
 {"ActivationFunction", "sigmoid", activationFunctionRe}, \
 {"InitStrategy", "auto", R"((auto|logistic|norm|relu)$)"}, \
 {"DropoutRate", "0.0", dropoutRateRe}, \
 {"TestFrequency", "9999999", Neuropia::Params::Int}, \
 {"L2", "0.0", Neuropia::Params::Real}, \
-{"Classes", "0", Neuropia::Params::Int} \
+{"Classes", "0", Neuropia::Params::Int}, \
+{"Freeze", "0", freezeRe}, \
+{"FreezeCache", "false", Neuropia::Params::Bool}, \
+{"ValidationSize", "200", Neuropia::Params::Int}, \
+{"ValidationImages", "", Neuropia::Params::File}, \
+{"ValidationLabels", "", Neuropia::Params::File}, \
+{"EarlyStopPatience", "0", Neuropia::Params::Int}, \
+{"EarlyStopDelta", "0.0", Neuropia::Params::Real}, \
+{"EarlyStopMetric", "accuracy", R"((accuracy|loss)$)"}, \
+{"TargetAccuracy", "0.0", Neuropia::Params::Real}, \
+{"Optimizer", "sgd", R"((sgd|momentum|nesterov|rmsprop|adam)$)"}, \
+{"Momentum", "0.9", Neuropia::Params::Real}, \
+{"Beta2", "0.999", Neuropia::Params::Real}, \
+{"Softmax", "false", Neuropia::Params::Bool}, \
+{"Profile", "false", Neuropia::Params::Bool}, \
+{"ProgressInterval", "200", Neuropia::Params::Int}, \
+{"TraceFile", "", Neuropia::Params::String}, \
+{"ProfileCounters", "false", Neuropia::Params::Bool}, \
+{"MatrixPoolCapacity", "64", Neuropia::Params::Int}, \
+{"Arena", "false", Neuropia::Params::Bool}, \
+{"Seed", "0", Neuropia::Params::Int}, \
+{"Prune", "0.0", Neuropia::Params::Real}, \
+{"PruneCycles", "1", Neuropia::Params::Int}, \
+{"PruneIterations", "0", Neuropia::Params::Int}, \
+{"Rank", "0", Neuropia::Params::Int}, \
+{"RankIterations", "0", Neuropia::Params::Int}, \
+{"Population", "0", Neuropia::Params::Int}, \
+{"Elite", "1", Neuropia::Params::Int}, \
+{"LearningRateSpread", "0.0", Neuropia::Params::Real} \
 
 #endif // DEFAULT_H
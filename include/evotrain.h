@@ -21,6 +21,9 @@ protected:
     unsigned m_jobs;
     size_t m_batchSize;
     size_t m_batchVerifySize;
+    unsigned m_population;
+    unsigned m_elite;
+    NeuronType m_learningRateSpread;
 };
 
 }
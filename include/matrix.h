@@ -10,10 +10,16 @@
 
 #include <map>
 #include <memory>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
 
 #include <thread>
 #include <sstream>
 
+#include "philox.h"
+
 #ifdef CHECK_VALUES
 #define VALIDATE(x) (matrix_assert(!(std::isnan(x) || std::isinf(x))))
 #else
@@ -35,67 +41,326 @@ namespace Neuropia {
  * Matrix operations do lot of alloc/dealloc and that is an issue
  * when having multiple threads using single memory std::allocator.
  *
- * However there is only pretty limited amount of different
- * Matrix sizes used (in Neuropia < 10) I have a pool for each
- * size. To avoid any conflict there is own pool for eaach thread.
+ * Blocks are pooled per size class, there are four classes for each
+ * power of two, hence lookup is just an index. To avoid any conflict
+ * there is own pool for each thread. A block freed in other thread than
+ * the one allocated it, or when the pool is full, is returned to the
+ * system.
  *
 */
+
+/**
+ * @brief The MatrixAllocatorBase class shares configuration and statistics of all MatrixAllocator pools
+ */
+class MatrixAllocatorBase {
+public:
+    /// @brief Pool statistics, summed over all threads
+    struct Stats {
+        /// @brief allocations served from the pool
+        size_t hits;
+        /// @brief allocations from the system
+        size_t misses;
+        /// @brief blocks freed in other thread than allocated
+        size_t remoteFrees;
+        /// @brief bytes currently held in pools
+        size_t held;
+        /// @brief peak of bytes held
+        size_t peak;
+        /// @brief hit rate
+        double hitRate() const {return hits + misses > 0 ? static_cast<double>(hits) / static_cast<double>(hits + misses) : 0.0;}
+    };
+
+    /**
+     * @brief stats
+     * @return
+     */
+    static Stats stats() {
+        return {s_hits.load(std::memory_order_relaxed), s_misses.load(std::memory_order_relaxed),
+                s_remoteFrees.load(std::memory_order_relaxed), s_held.load(std::memory_order_relaxed),
+                s_peak.load(std::memory_order_relaxed)};
+    }
+
+    /**
+     * @brief setCapacity
+     * @param bytes maximum bytes a thread pool holds, blocks freed beyond that are returned to the system
+     */
+    static void setCapacity(size_t bytes) {s_capacity = bytes;}
+
+    /**
+     * @brief capacity
+     * @return
+     */
+    static size_t capacity() {return s_capacity;}
+
+protected:
+    static constexpr size_t ClassCount = 9 + 4 * 58;
+
+    static size_t log2floor(size_t v) {
+#if defined(__GNUC__)
+        return static_cast<size_t>(63 - __builtin_clzll(v));
+#else
+        size_t r = 0;
+        while(v >>= 1)
+            ++r;
+        return r;
+#endif
+    }
+
+    // up to 64 bytes in 8 byte steps, then four classes per power of two
+    static size_t sizeClass(size_t bytes) {
+        if(bytes <= 64)
+            return (bytes + 7) / 8;
+        const auto p = log2floor(bytes - 1);
+        const auto sub = (bytes - 1) >> (p - 2);
+        return 9 + (p - 6) * 4 + (sub - 4);
+    }
+
+    static size_t classBytes(size_t sizeClass) {
+        if(sizeClass <= 8)
+            return sizeClass * 8;
+        const auto c = sizeClass - 9;
+        return (4 + c % 4 + 1) << (6 + c / 4 - 2);
+    }
+
+    static void held(size_t bytes) {
+        const auto current = s_held.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        auto peak = s_peak.load(std::memory_order_relaxed);
+        while(current > peak && !s_peak.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {}
+    }
+
+    static void released(size_t bytes) {s_held.fetch_sub(bytes, std::memory_order_relaxed);}
+
+protected:
+    static inline std::atomic<size_t> s_capacity{64 * 1024 * 1024};
+    static inline std::atomic<size_t> s_hits{0};
+    static inline std::atomic<size_t> s_misses{0};
+    static inline std::atomic<size_t> s_remoteFrees{0};
+    static inline std::atomic<size_t> s_held{0};
+    static inline std::atomic<size_t> s_peak{0};
+};
+
+/**
+ * @brief The MatrixArena class is a per thread bump pointer allocator for temporaries of a single training step.
+ * While a Scope is active MatrixAllocator of that thread allocates from the arena and deallocation
+ * is a no-op, all memory is released at once as the Scope ends. Nothing allocated within a Scope may
+ * outlive it. Chunks are merged on reset, hence in a long run the arena settles to a single chunk.
+ */
+class MatrixArena {
+public:
+    /**
+     * @brief The Scope class activates the calling thread arena on its lifetime, nested scopes use the outermost
+     */
+    class Scope {
+    public:
+        explicit Scope(bool enabled = true) : m_arena(enabled && s_current == nullptr ? &thread() : nullptr) {
+            if(m_arena)
+                s_current = m_arena;
+        }
+        ~Scope() {
+            if(m_arena) {
+                s_current = nullptr;
+                m_arena->reset();
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        MatrixArena* const m_arena;
+    };
+
+    /**
+     * @brief thread
+     * @return arena of the calling thread
+     */
+    static MatrixArena& thread() {
+        thread_local MatrixArena arena;
+        return arena;
+    }
+
+    /**
+     * @brief current
+     * @return arena active in the calling thread, nullptr if none
+     */
+    static MatrixArena* current() {return s_current;}
+
+    /**
+     * @brief allocate
+     * @param bytes
+     * @return memory aligned as std::max_align_t
+     */
+    void* allocate(size_t bytes) {
+        const auto units = (bytes + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+        if(m_chunks.empty() || m_offset + units > m_chunks.back().size) {
+            const auto chunkUnits = std::max(units, ChunkSize / sizeof(std::max_align_t));
+            m_chunks.push_back({std::make_unique<std::max_align_t[]>(chunkUnits), chunkUnits});
+            m_offset = 0;
+        }
+        auto ptr = m_chunks.back().data.get() + m_offset;
+        m_offset += units;
+        m_used += units * sizeof(std::max_align_t);
+        m_live.fetch_add(1, std::memory_order_relaxed);
+        return ptr;
+    }
+
+    /**
+     * @brief free, a no-op but counted to catch allocations outliving the Scope, can be called in any thread
+     */
+    void free() {m_live.fetch_sub(1, std::memory_order_relaxed);}
+
+    /**
+     * @brief reset releases all allocations, chunks are merged to one large enough for the peak use
+     */
+    void reset() {
+        matrix_assert(m_live.load(std::memory_order_relaxed) == 0);
+        auto peak = s_peak.load(std::memory_order_relaxed);
+        while(m_used > peak && !s_peak.compare_exchange_weak(peak, m_used, std::memory_order_relaxed)) {}
+        if(m_chunks.size() > 1) {
+            size_t units = 0;
+            for(const auto& c : m_chunks)
+                units += c.size;
+            m_chunks.clear();
+            m_chunks.push_back({std::make_unique<std::max_align_t[]>(units), units});
+        }
+        m_offset = 0;
+        m_used = 0;
+        m_live.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief capacity
+     * @return bytes reserved by this arena
+     */
+    size_t capacity() const {
+        size_t units = 0;
+        for(const auto& c : m_chunks)
+            units += c.size;
+        return units * sizeof(std::max_align_t);
+    }
+
+    /**
+     * @brief peak
+     * @return largest bytes used within a Scope, over all threads
+     */
+    static size_t peak() {return s_peak.load(std::memory_order_relaxed);}
+
+    MatrixArena(const MatrixArena&) = delete;
+    MatrixArena& operator=(const MatrixArena&) = delete;
+
+private:
+    MatrixArena() = default;
+    static constexpr size_t ChunkSize = 256 * 1024;
+    struct Chunk {
+        std::unique_ptr<std::max_align_t[]> data;
+        size_t size;
+    };
+    std::vector<Chunk> m_chunks = {};
+    size_t m_offset = 0;
+    size_t m_used = 0;
+    std::atomic<size_t> m_live{0};
+    static inline thread_local MatrixArena* s_current = nullptr;
+    static inline std::atomic<size_t> s_peak{0};
+};
+
 template <class T>
-class MatrixAllocator {
+class MatrixAllocator : public MatrixAllocatorBase {
 public:
     using value_type = T;
     using propagate_on_container_move_assignment = std::true_type;
 private:
+    struct Pool;
+    // owner is nullptr for blocks allocated from the MatrixArena, then arena is the one allocated it, as the block may
+    // be freed in another thread
+    struct Header {
+        Pool* owner;
+        union {
+            Header* next;
+            MatrixArena* arena;
+        };
+    };
+    static constexpr size_t HeaderSize = std::max(sizeof(Header), alignof(std::max_align_t));
     struct Pool {
         Pool() = default;
         Pool(const Pool&) = delete;
         Pool(Pool&&) = delete;
-        struct Node {
-            Node* next;
-            T* block;
-        };
-        std::map<size_t, Node*> nodes = {};
-        ~Pool() {
-            std::allocator<char> byteAllocator;
-            for(auto it = nodes.begin(); it != nodes.end(); it++) {
-                const auto size = it->first;
-                auto n = it->second;
+        std::array<Header*, ClassCount> heads = {};
+        size_t held = 0;
+        void clear() {
+            for(auto c = 0U; c < heads.size(); c++) {
+                auto n = heads[c];
                 while(n) {
                     auto next = n->next;
-                    byteAllocator.deallocate(reinterpret_cast<char*>(n), size * sizeof(T) + sizeof(void*));
+                    release(n, c);
                     n = next;
                 }
+                heads[c] = nullptr;
             }
+            MatrixAllocatorBase::released(held);
+            held = 0;
+        }
+        ~Pool() {
+            clear();
         }
     };
+
+    static void release(Header* header, size_t sizeClass) {
+        std::allocator<char> byteAllocator;
+        byteAllocator.deallocate(reinterpret_cast<char*>(header), HeaderSize + classBytes(sizeClass));
+    }
+
 public:
     MatrixAllocator() {}
     template <class U> MatrixAllocator(MatrixAllocator<U> const&) noexcept {}
     T* allocate(size_t size) {
-        const auto it = m_pool.nodes.find(size);
-        if(it == m_pool.nodes.end() || it->second == nullptr) {
+        if(auto arena = MatrixArena::current()) {
+            auto header = new (arena->allocate(HeaderSize + size * sizeof(T))) Header{nullptr, {nullptr}};
+            header->arena = arena;
+            return reinterpret_cast<T*>(reinterpret_cast<char*>(header) + HeaderSize);
+        }
+        const auto sizeClass = MatrixAllocatorBase::sizeClass(size * sizeof(T));
+        auto& pool = m_pool;
+        auto header = pool.heads[sizeClass];
+        if(header == nullptr) {
+            s_misses.fetch_add(1, std::memory_order_relaxed);
             std::allocator<char> byteAlloc;
-            auto bytes = byteAlloc.allocate(sizeof(T) * size + sizeof(void*));
-            return reinterpret_cast<T*>(bytes + sizeof(void*));
+            auto bytes = byteAlloc.allocate(HeaderSize + classBytes(sizeClass));
+            header = new (bytes) Header{&pool, nullptr};
+        } else {
+            s_hits.fetch_add(1, std::memory_order_relaxed);
+            pool.heads[sizeClass] = header->next;
+            pool.held -= classBytes(sizeClass);
+            MatrixAllocatorBase::released(classBytes(sizeClass));
         }
-
-        auto node = it->second;
-        auto next = node->next;
-        it->second = next;
-        return node->block;
-
+        return reinterpret_cast<T*>(reinterpret_cast<char*>(header) + HeaderSize);
     }
     void deallocate(T* ptr, size_t size) {
-        auto node = reinterpret_cast<typename MatrixAllocator<T>::Pool::Node*>(reinterpret_cast<char*>(ptr) - sizeof(void*));
-        node->block = ptr;
-        const auto it = m_pool.nodes.find(size);
-        if(it == m_pool.nodes.end()) {
-            m_pool.nodes.emplace(size, node);
-            node->next = nullptr;
-        } else {
-            node->next = it->second;
-            it->second = node;
+        auto header = reinterpret_cast<Header*>(reinterpret_cast<char*>(ptr) - HeaderSize);
+        if(header->owner == nullptr) {
+            header->arena->free();
+            return;
         }
+        const auto sizeClass = MatrixAllocatorBase::sizeClass(size * sizeof(T));
+        const auto bytes = classBytes(sizeClass);
+        auto& pool = m_pool;
+        if(header->owner != &pool) {
+            s_remoteFrees.fetch_add(1, std::memory_order_relaxed);
+            release(header, sizeClass);
+            return;
+        }
+        if(pool.held + bytes > s_capacity.load(std::memory_order_relaxed)) {
+            release(header, sizeClass);
+            return;
+        }
+        header->next = pool.heads[sizeClass];
+        pool.heads[sizeClass] = header;
+        pool.held += bytes;
+        MatrixAllocatorBase::held(bytes);
+    }
+
+    /**
+     * @brief trim returns all blocks pooled in the calling thread to the system
+     */
+    static void trim() {
+        m_pool.clear();
     }
 private:
     thread_local static Pool m_pool;
@@ -113,19 +378,20 @@ template <class T, class U>
 bool operator!=(MatrixAllocator<T> const& x, MatrixAllocator<U> const& y) noexcept {
     return !(x == y);
 }
+
+/// @brief Vector allocated as Matrix data, i.e. from the pool or the active MatrixArena
+template <typename T>
+using MatrixVector = std::vector<T, MatrixAllocator<T>>;
+#else
+template <typename T>
+using MatrixVector = std::vector<T>;
 #endif
 
 template <typename T>
 class Matrix {
-#ifndef STD_ALLOCATOR
-    typedef std::vector<T, MatrixAllocator<T>> MatrixData;
-public:
-    typedef typename std::vector<T, MatrixAllocator<T>>::size_type index_type;
-#else
-    typedef std::vector<T> MatrixData;
+    typedef MatrixVector<T> MatrixData;
 public:
-    typedef typename std::vector<T>::size_type index_type;
-#endif
+    typedef typename MatrixData::size_type index_type;
 public:
     enum class VecDir {row, col};
     Matrix(index_type c, index_type r) noexcept : m_data(c * r), m_colSize(c) {
@@ -171,21 +437,13 @@ public:
     }
 
     void randomize(T min = 0, T max = static_cast<T>(1.0)) {
-        unsigned seed =
-#ifndef RANDOM_SEED
-                static_cast<unsigned>(std::chrono::system_clock::now().time_since_epoch().count())
-#else
-                RANDOM_SEED
-#endif
-                ;
-        std::default_random_engine rd(seed);  //Will be used to obtain a seed for the random number engine
-        std::mt19937 gen(rd()); //Standard mersenne_twister_engine seeded with rd()
+        auto& gen = Philox::thread();
         std::uniform_real_distribution<> dis(min, max);
 
-        for(auto  j = 0; j < rows(); j++) {
-            for(auto  i = 0; i < cols(); i++) {
+        for(index_type j = 0; j < rows(); j++) {
+            for(index_type i = 0; i < cols(); i++) {
                 operator()(i, j) =
-                    dis(gen);
+                    static_cast<T>(dis(gen));
             }
         }
     }
@@ -199,6 +457,7 @@ public:
     inline index_type cols() const noexcept {return m_colSize;}
 
     const MatrixData& data() const noexcept {return m_data;}
+    MatrixData& data() noexcept {return m_data;}
 
     Matrix concatCols(const Matrix& a) const {
         matrix_assert(a.rows() == rows());
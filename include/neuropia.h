@@ -14,6 +14,10 @@
 #include <chrono>
 #include <optional>
 #include <fstream>
+#include <iterator>
+#include <numeric>
+#include <atomic>
+#include "optimizer.h"
 
 /**
  * Namespace Neuropia
@@ -49,6 +53,9 @@ inline bool doAssert(const std::string& s, int line, const char* file, const std
 #define NEUROPIA_TYPE double
 #endif
 
+#include "matrix.h"
+#include "philox.h"
+
 namespace Neuropia {
     /// @brief @Value type used in Neuropia (NEUROPIA_TYPE is compile time defined- see a CMakeLists.txt)
     using NeuronType = NEUROPIA_TYPE;
@@ -78,6 +85,11 @@ using ValueMap = std::unordered_map<int, NeuronType>;
  * Array type for NeuronType
  */
 using ValueVector = std::vector<NeuronType>;
+/**
+ * @brief TempVector
+ * Array type for NeuronType temporaries, allocated as Matrix data
+ */
+using TempVector = MatrixVector<NeuronType>;
 
 /// @brief Network creation parameters map type - See Params
 using MetaInfo = std::unordered_map<std::string, std::string>;
@@ -102,6 +114,8 @@ struct Header {
     const unsigned layers;
     /// @brief Endianness used
     const bool bigEndian;
+    /// @brief Format version, 6 if layers may be stored as compressed sparse rows, else 5
+    const unsigned version;
 };
 
 
@@ -209,6 +223,38 @@ ACTIVATION_FUNCTION(eluFunction, [](Neuropia::NeuronType value) noexcept -> Neur
     return static_cast<NeuronType>(value < 0.0 ? EluFactor * (std::exp(value) - 1.0) : value);
 })
 
+/// @brief Linear function, passes the sum as is, e.g. for the first stage of a factorized layer
+ACTIVATION_FUNCTION(linearFunction, [](Neuropia::NeuronType value) noexcept -> Neuropia::NeuronType {
+    return value;
+})
+
+/// @brief Softmax function, neurons pass their sums and the layer normalizes them to probabilities.
+/// As an output layer it is trained with cross-entropy loss, which gradient is just the error.
+ACTIVATION_FUNCTION(softmaxFunction, [](Neuropia::NeuronType value) noexcept -> Neuropia::NeuronType {
+    return value;
+})
+
+/**
+ * @brief softmax
+ * Normalizes values to probabilities in place
+ * @param begin
+ * @param end
+ */
+template<typename IT>
+void softmax(IT begin, IT end) {
+    if(begin == end)
+        return;
+    const auto max = *std::max_element(begin, end);
+    typename std::iterator_traits<IT>::value_type sum = 0;
+    for(auto it = begin; it != end; ++it) {
+        *it = std::exp(*it - max);  // max is subtracted to avoid overflow
+        sum += *it;
+    }
+    for(auto it = begin; it != end; ++it) {
+        *it /= sum;
+    }
+}
+
 
 
 /**
@@ -234,6 +280,12 @@ DERIVATIVE_FUNCTION(eluFunctionDerivative, [](Neuropia::NeuronType value) noexce
     return static_cast<NeuronType>(value > 0.0 ? 1.0 : EluFactor * std::exp(value));
 })
 
+/// @brief Linear derivative function
+DERIVATIVE_FUNCTION(linearFunctionDerivative, [](Neuropia::NeuronType value) noexcept -> Neuropia::NeuronType {
+    (void) value;
+    return static_cast<NeuronType>(1.0);
+})
+
 /**
  * @brief normalize
  * Helper function to normalize input [-1, 1]
@@ -249,6 +301,9 @@ NeuronType normalize(NeuronType value, NeuronType min, NeuronType max) {
     return (value - min) / (max - min);
 }
 
+/// @brief Scale that normalizes bytes as normalize(value, 0, 255) when given to feed with raw input
+constexpr NeuronType ByteScale = static_cast<NeuronType>(1.0 / 255.0);
+
 /**
  * @brief derivativeMap
  * @param activation_function
@@ -354,6 +409,39 @@ public:
     template<typename IT>
     NeuronType feed(IT begin, IT end) const;
 
+    /**
+     * @brief feedSparse, only inputs at given indices are summed, others are expected to be zero
+     * @param begin
+     * @param indices of the nonzero inputs
+     * @return
+     */
+    template<typename IT>
+    NeuronType feedSparse(IT begin, const std::vector<unsigned>& indices) const;
+
+    /**
+     * @brief feedCompressed, weights are given as a compressed sparse row, weights of the neuron are not used
+     * @param begin
+     * @param columns input index per weight
+     * @param values weights
+     * @param count number of weights
+     * @return
+     */
+    template<typename IT>
+    NeuronType feedCompressed(IT begin, const uint32_t* columns, const NeuronType* values, size_t count) const;
+
+    /**
+     * @brief feed raw input, e.g. bytes, normalized as value * scale + offset.
+     * Normalization is folded into the sum, i.e. sum(w * (x * s + o)) = s * sum(w * x) + o * sum(w),
+     * so inputs are only widened in the loop, and the weights are summed only for a nonzero offset.
+     * @param begin
+     * @param end
+     * @param scale
+     * @param offset
+     * @return
+     */
+    template<typename IT>
+    NeuronType feed(IT begin, IT end, NeuronType scale, NeuronType offset) const;
+
     /**
      * @brief size
      * @return
@@ -417,6 +505,7 @@ public:
     size_t consumption() const;
 
     friend std::ostream& ::operator<<(std::ostream& output, const Neuron& neuron);
+    friend class Layer;
 
     // @internal
     [[nodiscard]] bool loadNeuron(StreamBase& stream, SaveType saveType);
@@ -427,11 +516,77 @@ private:
     NeuronType m_bias = 1;
 };
 
+class ThreadPool;
+
+/**
+ * @brief The SharedVector class is a vector shared by its copies, hence a copy is O(1). It is read as a const vector,
+ * and write() copies the values first if they are shared.
+ */
+template<typename T>
+class SharedVector {
+public:
+    /// @brief const_iterator
+    using const_iterator = typename std::vector<T>::const_iterator;
+
+    SharedVector() = default;
+
+    /**
+     * @brief SharedVector
+     * @param values
+     */
+    SharedVector(std::vector<T>&& values) : m_values(std::make_shared<std::vector<T>>(std::move(values))) {}
+
+    /**
+     * @brief values
+     * @return
+     */
+    const std::vector<T>& values() const {
+        static const std::vector<T> empty = {};
+        return m_values ? *m_values : empty;
+    }
+
+    /**
+     * @brief write
+     * @return values that are not shared with any copy
+     */
+    std::vector<T>& write() {
+        if(!m_values) {
+            m_values = std::make_shared<std::vector<T>>();
+        } else if(m_values.use_count() > 1) {
+            m_values = std::make_shared<std::vector<T>>(*m_values);
+        } else {
+            // copies released in other threads are done with the values before they are written
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return *m_values;
+    }
+
+    /**
+     * @brief isShared
+     * @return true if a copy shares the values
+     */
+    bool isShared() const {return m_values.use_count() > 1;}
+
+    /// @cond
+    size_t size() const {return m_values ? m_values->size() : 0;}
+    bool empty() const {return size() == 0;}
+    const T& operator[](size_t index) const {return (*m_values)[index];}
+    const_iterator begin() const {return values().begin();}
+    const_iterator end() const {return values().end();}
+    /// @endcond
+private:
+    std::shared_ptr<std::vector<T>> m_values = nullptr;
+};
+
 /**
  * @brief The Layer class
  */
 class Layer {
 public:
+    /// @brief Inputs having at most this fraction of nonzero values are fed only by their nonzero values
+    static constexpr NeuronType SparseDensity = static_cast<NeuronType>(0.5);
+    /// @brief Default minimum number of weights a thread feeds in a parallel feed, a smaller layer is not split
+    static constexpr size_t ParallelFeedWork = 1U << 15;
 
     /**
      * @brief Layer
@@ -468,7 +623,7 @@ public:
     Layer(Layer&& other) noexcept;
 
     /**
-     * @brief Layer
+     * @brief Layer, neurons are shared with other until either is modified
      * @param other
      */
     Layer(const Layer& other) noexcept;
@@ -481,7 +636,7 @@ public:
     Layer& operator=(Layer&& other) noexcept;
 
     /**
-     * @brief operator =
+     * @brief operator =, neurons are shared with other until either is modified
      * @param other
      * @return
      */
@@ -582,6 +737,43 @@ public:
      */
     const ValueVector& feed(IT begin, IT end) const;
 
+    template<typename IT>
+    /**
+     * @brief feed raw input, e.g. image bytes, without converting it to NeuronType first
+     * @param begin
+     * @param end
+     * @param scale input is normalized as value * scale + offset in the first layer, e.g. 1 / 255 for bytes
+     * @param offset
+     * @return
+     */
+    const ValueVector& feed(IT begin, IT end, NeuronType scale, NeuronType offset = 0) const;
+
+    template<typename IT>
+    /**
+     * @brief feed a single input with low latency, neurons of a layer are split to parts fed by the threads of pool,
+     * the next layer is fed when all parts are done. Called on the input layer.
+     * @param begin
+     * @param end
+     * @param pool threads feeding a layer, the calling thread is one of them
+     * @param minWork minimum number of weights fed by a thread, a layer of less is fed by the calling thread only
+     * @return
+     */
+    const ValueVector& feed(IT begin, IT end, ThreadPool& pool, size_t minWork = ParallelFeedWork) const;
+
+    template<typename IT>
+    /**
+     * @brief feed raw input in parallel, inputs are normalized in the input layer as value * scale + offset,
+     * see feed(begin, end, pool, minWork)
+     * @param begin
+     * @param end
+     * @param scale
+     * @param offset
+     * @param pool
+     * @param minWork
+     * @return
+     */
+    const ValueVector& feed(IT begin, IT end, NeuronType scale, NeuronType offset, ThreadPool& pool, size_t minWork = ParallelFeedWork) const;
+
     /**
      * @brief feed
      * @param vec
@@ -609,25 +801,81 @@ public:
      * @return
      */
     bool train(IteratorItInput inputs, IteratorItOutput expectedOutputs, NeuronType learningRate, NeuronType lambdaL2, const DerivativeFunction& derivativeFunction = nullptr) {
-        const auto seed =
-#ifndef RANDOM_SEED
-                static_cast<unsigned>(std::chrono::system_clock::now().time_since_epoch().count())
-#else
-        RANDOM_SEED
-#endif
-        ;
-        std::default_random_engine gen(seed);
-        dropout(gen);
+        const auto& out = trainForward(inputs);
+        return trainBackward(out, expectedOutputs, learningRate, lambdaL2, derivativeFunction);
+    }
 
-        const auto out = feedTrain(inputs, inputs + static_cast<int>(m_neurons.size())); //go forward first
-        ValueVector expectedValues(out.size());
+    template<typename IteratorItInput, typename IteratorItOutput>
+    /**
+     * @brief train using cached activations of the topmost frozen layer
+     * @param inputs
+     * @param expectedOutputs
+     * @param learningRate
+     * @param lambdaL2
+     * @param frozenActivations if empty, network is fed from inputs and the frozen layer output is stored here,
+     * else the frozen layers are not fed at all and the forward pass starts from these values.
+     * @param derivativeFunction
+     * @return
+     */
+    bool train(IteratorItInput inputs, IteratorItOutput expectedOutputs, NeuronType learningRate, NeuronType lambdaL2, ValueVector& frozenActivations, const DerivativeFunction& derivativeFunction = nullptr) {
+        const auto& out = trainForward(inputs, frozenActivations);
+        return trainBackward(out, expectedOutputs, learningRate, lambdaL2, derivativeFunction);
+    }
+
+    template<typename IteratorItInput>
+    /**
+     * @brief trainForward, the forward half of train, dropout is applied and the network is fed
+     * @param inputs
+     * @return output values to be passed to trainBackward
+     */
+    const ValueVector& trainForward(IteratorItInput inputs) {
+        dropout(Philox::thread());
+        return feedTrain(inputs, inputs + static_cast<int>(m_neurons.size())); //go forward first
+    }
+
+    template<typename IteratorItInput>
+    /**
+     * @brief trainForward using cached activations of the topmost frozen layer, see train
+     * @param inputs
+     * @param frozenActivations
+     * @return output values to be passed to trainBackward
+     */
+    const ValueVector& trainForward(IteratorItInput inputs, ValueVector& frozenActivations) {
+        const auto frozen = frozenLayer();
+        if(frozen == nullptr || frozen->isOutput()) {
+            return trainForward(inputs);
+        }
+        dropout(Philox::thread());
+
+        if(frozenActivations.empty()) {
+            const auto& out = feedTrain(inputs, inputs + static_cast<int>(m_neurons.size()));
+            frozenActivations = frozen->m_outBuffer;
+            return out;
+        }
+        neuropia_assert(frozenActivations.size() == frozen->m_outBuffer.size());
+        frozen->m_outBuffer = frozenActivations;
+        return frozen->m_next->feedTrain(frozen->m_outBuffer.begin(), frozen->m_outBuffer.end());
+    }
+
+    template<typename IteratorItOutput>
+    /**
+     * @brief trainBackward, the backward half of train
+     * @param out values returned by trainForward
+     * @param expectedOutputs
+     * @param learningRate
+     * @param lambdaL2
+     * @param derivativeFunction
+     * @return
+     */
+    bool trainBackward(const ValueVector& out, IteratorItOutput expectedOutputs, NeuronType learningRate, NeuronType lambdaL2, const DerivativeFunction& derivativeFunction = nullptr) {
+        TempVector expectedValues(out.size());
         std::copy(expectedOutputs, expectedOutputs + static_cast<int>(out.size()), expectedValues.begin());
         const auto derivativeFunction_ptr = derivativeFunction == nullptr ? Neuropia::derivativeMap(m_activationFunction) : derivativeFunction;
         return backpropagation(out, expectedValues, learningRate, lambdaL2, derivativeFunction_ptr);
     }
 
     /**
-     * @brief dropout
+     * @brief dropout, a frozen layer is not dropped out and its rate is kept zero
      * @param dropoutRate
      * @param inherit
      */
@@ -639,12 +887,108 @@ public:
      */
     void inverseDropout(bool inherit = true);
 
+    /**
+     * @brief inferenceCopy
+     * @return copy of network where dropout is inversed, this network is not changed
+     */
+    Layer inferenceCopy() const;
+
+    /**
+     * @brief setOptimizer, the optimizer state is reset
+     * @param optimizer
+     * @param inherit
+     */
+    void setOptimizer(const Optimizer& optimizer, bool inherit = true);
+
+    /**
+     * @brief optimizer
+     * @return
+     */
+    const Optimizer& optimizer() const {return m_optimizer;}
+
     /**
      * @brief size
      * @return
      */
     size_t size() const {return m_neurons.size();}
 
+    /**
+     * @brief prune, zeroes the smallest magnitude weights so that given fraction of the layer weights are zero.
+     * Zero weights of a pruned layer stay zero in training, and the layer is fed and stored as compressed sparse rows.
+     * @param sparsity fraction of zero weights, 0 leaves the layer as is
+     * @param inherit
+     */
+    void prune(NeuronType sparsity, bool inherit = true);
+
+    /**
+     * @brief factorize, replaces the weight matrix W of this layer with its rank limited approximation U * V by truncated SVD.
+     * A linear layer of rank neurons, having V as weights, is inserted before this layer and U becomes the weights of this layer.
+     * Feed is cheaper when rank < inputs * neurons / (inputs + neurons). Both stages are ordinary layers and can be fine-tuned.
+     * @param rank number of singular values kept, at most min(inputs, neurons)
+     * @return the inserted layer
+     */
+    Layer& factorize(size_t rank);
+
+    /**
+     * @brief isPruned
+     * @return
+     */
+    bool isPruned() const {return m_pruned;}
+
+    /**
+     * @brief sparsity
+     * @return fraction of the layer weights that are zero
+     */
+    NeuronType sparsity() const;
+
+    /**
+     * @brief removeNeurons, removes neurons of a hidden layer and their weights in the next layer, i.e. the layer shrinks
+     * @param indices of the removed neurons
+     * @param means mean activation per neuron of this layer, if given it is added via the removed weights to
+     * the biases of the next layer, hence removal of a neuron having a constant activation does not change the outputs
+     */
+    void removeNeurons(const std::vector<unsigned>& indices, const ValueVector& means = {});
+
+    /**
+     * @brief outputs
+     * @return values of the latest feed of this layer
+     */
+    const ValueVector& outputs() const {return m_outBuffer;}
+
+    /**
+     * @brief compress, builds the compressed sparse rows of a pruned layer that are used in feed.
+     * They are built on prune and load, and dropped when training changes the weights.
+     * @param inherit
+     */
+    void compress(bool inherit = true);
+
+    /**
+     * @brief freeze, weights of a frozen layer are not updated in training. As the backpropagation stops
+     * at the topmost frozen layer, all layers below it are not updated either. A frozen layer is not dropped out,
+     * hence dropout of the layer is inversed when it is frozen, and its weights are not changed by inverseDropout.
+     * @param frozen
+     */
+    void freeze(bool frozen);
+
+    /**
+     * @brief isFrozen
+     * @return
+     */
+    bool isFrozen() const {return m_frozen;}
+
+    /**
+     * @brief isDropped
+     * @param index
+     * @return true if the neuron is dropped out in the current training step
+     */
+    bool isDropped(size_t index) const {return !m_dropped.empty() && m_dropped[index];}
+
+    /**
+     * @brief frozenLayer
+     * @return topmost frozen layer, nullptr if there is none
+     */
+    const Layer* frozenLayer() const;
+
     /**
      * @brief isInput
      * @return
@@ -692,6 +1036,15 @@ public:
      */
     void merge(const Layer& other, NeuronType factor);
 
+    /**
+     * @brief mergeAll, weights, biases and optimizer states are set to the weighted average of replicas in one pass,
+     * this network is not one of them
+     * @param replicas networks of the same topology
+     * @param factors per replica e.g. its validation score, empty for the mean
+     * @param pool if set, neurons are averaged in parallel
+     */
+    void mergeAll(const std::vector<Layer>& replicas, const ValueVector& factors = {}, ThreadPool* pool = nullptr);
+
     /**
      * @brief compare
      * @param other
@@ -748,7 +1101,7 @@ public:
      * @brief setActivationFunction
      * @param activation_function
      */
-    void setActivationFunction(const ActivationFunction& activation_function) {m_activationFunction = activation_function;}
+    void setActivationFunction(const ActivationFunction& activation_function);
 
     /**
      * @brief activationFunction
@@ -806,55 +1159,123 @@ public:
     const Layer* next() const {return get(1);}
     
  protected:
-    [[nodiscard]] bool loadLayer(StreamBase& stream, SaveType saveType, unsigned layer_count);
+    [[nodiscard]] bool loadLayer(StreamBase& stream, SaveType saveType, unsigned version, unsigned layer_count);
+    // reads this layer only
+    [[nodiscard]] bool readLayer(StreamBase& stream, SaveType saveType, unsigned version);
+    // writes this layer only, pruned if the file has storage types
+    void saveLayer(std::ofstream& stream, SaveType saveType, bool pruned) const;
+    // copies this layer only, following layers are not touched
+    void assignLayer(const Layer& other);
+
+    // true if stored as compressed sparse rows, i.e. it is pruned and that is smaller
+    bool isStoredSparse(SaveType saveType) const;
+    [[nodiscard]] bool loadCompressed(StreamBase& stream, SaveType saveType);
 
     Layer* previousLayer(Layer* current);
     const Layer* previousLayer(const Layer* current) const;
 
-    bool backpropagation(const ValueVector& out, const ValueVector& expected, NeuronType learningRate, NeuronType lambdaL2, const DerivativeFunction& derivativeFunction);
-    void dropout(std::default_random_engine& gen);
+    size_t depth() const;
+
+    // collects indices of nonzero inputs, returns false if they are too dense to be fed sparse
+    template<typename IT>
+    bool sparseInputs(IT begin, IT end) const {
+        const auto sz = static_cast<size_t>(std::distance(begin, end));
+        const auto limit = static_cast<size_t>(SparseDensity * static_cast<NeuronType>(sz));
+        m_nonZero.clear();
+        m_nonZero.reserve(limit);
+        for(size_t i = 0; i < sz; i++) {
+            if(*(begin + static_cast<typename IT::difference_type>(i)) != 0) {
+                if(m_nonZero.size() == limit)
+                    return false;
+                m_nonZero.push_back(static_cast<unsigned>(i));
+            }
+        }
+        return true;
+    }
+
+    bool backpropagation(const ValueVector& out, const TempVector& expected, NeuronType learningRate, NeuronType lambdaL2, const DerivativeFunction& derivativeFunction);
+
+    void dropout(Philox& gen);
 
     std::optional<MetaInfo> doLoad(StreamBase& stream);
 
     template<typename IteratorIt>
     const ValueVector& feedTrain(IteratorIt begin, IteratorIt end) const {
+        feedTrainLayer(begin, end);
+        auto layer = this;
+        for(; layer->m_next != nullptr; layer = layer->m_next.get()) {
+            layer->m_next->feedTrainLayer(layer->m_outBuffer.begin(), layer->m_outBuffer.end());
+        }
+        return layer->m_outBuffer;
+    }
+
+    // feeds this layer only, in train
+    template<typename IteratorIt>
+    void feedTrainLayer(IteratorIt begin, IteratorIt end) const {
         if(!isInput()) {
             const auto p = 1.0  - m_dropOut;
-            for(size_t i = 0; i < m_neurons.size(); i++) {
-                const auto& n = m_neurons[i];
-                if(n.isActive()) {
-                    const auto sz = static_cast<size_t>(std::distance(begin, end));
-                    ValueVector values(sz);
-                    const auto prevBegin = previousLayer(this)->begin();
-                    for(auto j = 0U; j < sz; j++) {
-                        values[j] = (prevBegin + j)->isActive() ? *(begin + j) : 0;
-                    }
-                    const auto out = n.feed(values.begin(), values.end());
-                    m_outBuffer[i] = out * p;
-                } else {
-                    m_outBuffer[i] = 0;
-                }
+            // inputs from dropped neurons are already zero, only the active neurons are fed
+            if(!m_dropped.empty()) {
+                std::fill(m_outBuffer.begin(), m_outBuffer.begin() + static_cast<long>(m_neurons.size()), 0);
+            }
+            const auto sparse = sparseInputs(begin, end);
+            for(const auto i : m_active) {
+                const auto out = sparse ? m_neurons[i].feedSparse(begin, m_nonZero) : m_neurons[i].feed(begin, end);
+                m_outBuffer[i] = out * p;
+            }
+            if(m_activationFunction == softmaxFunction) {
+                softmax(m_outBuffer.begin(), m_outBuffer.begin() + static_cast<long>(m_neurons.size()));
             }
         } else {
             for(auto it = begin; it != end; it++) {
                 const auto index = static_cast<unsigned>(std::distance(begin, it));
-                m_outBuffer[index] = m_neurons[index].isActive() ? *it : 0;  //copy value only if corresponding neuron is active
+                m_outBuffer[index] = !isDropped(index) ? *it : 0;  //copy value only if corresponding neuron is active
             }
         }
-        if(m_next != nullptr) {
-            return m_next->feedTrain(m_outBuffer.begin(), m_outBuffer.end());
-        }
-        return  m_outBuffer;
+    }
+
+    // feeds this layer only
+    template<typename IT>
+    void feedLayer(IT begin, IT end) const;
+
+    // feeds neurons from first to last of this layer, m_nonZero is set if sparse
+    template<typename IT>
+    void feedNeurons(IT begin, IT end, bool sparse, size_t first, size_t last) const;
+
+    // parallel versions of feedLayer and feedForward
+    void feedLayer(const ValueVector& inputs, ThreadPool& pool, size_t minWork) const;
+    const ValueVector& feedForward(ThreadPool& pool, size_t minWork) const;
 
+    // feeds following layers from the output of this, layers are passed iteratively
+    const ValueVector& feedForward() const {
+        auto layer = this;
+        for(; layer->m_next != nullptr; layer = layer->m_next.get()) {
+            layer->m_next->feedLayer(layer->m_outBuffer.begin(), layer->m_outBuffer.end());
+        }
+        return layer->m_outBuffer;
     }
 
 private:
-    std::vector<Neuron> m_neurons = {};
+    SharedVector<Neuron> m_neurons = {};  // shared by copies until either is modified
     std::unique_ptr<Layer> m_next = nullptr;
     Layer* m_prev = nullptr;
     ActivationFunction m_activationFunction = nullptr;
     NeuronType m_dropOut = 0.0;
+    bool m_frozen = false;
+    Optimizer m_optimizer = {};
+    OptimizerState m_optimizerState = {};
     mutable ValueVector m_outBuffer = {};
+    std::vector<uint8_t> m_dropped = {};  // per neuron, empty if none is dropped
+    std::vector<unsigned> m_active = {};  // ascending indices of neurons not dropped
+    mutable std::vector<unsigned> m_nonZero = {};  // ascending indices of nonzero inputs of the last sparse feed
+    bool m_pruned = false;
+    // compressed sparse rows of a pruned layer, row i weights are from offsets[i] to offsets[i + 1]
+    struct Csr {
+        std::vector<uint32_t> offsets = {};
+        std::vector<uint32_t> columns = {};
+        ValueVector values = {};
+    };
+    std::shared_ptr<const Csr> m_csr = nullptr;  // read only, shared by copies, nullptr if not compressed
 };
 
 
@@ -877,24 +1298,120 @@ NeuronType Neuron::feed(IT begin, IT end) const {
     return m_af(sum);
 }
 
+template<typename IT>
+NeuronType Neuron::feedSparse(IT begin, const std::vector<unsigned>& indices) const {
+    neuropia_assert(m_af);
+    NeuronType sum = m_bias;
+    for(const auto i : indices) {
+        neuropia_assert(i < m_weights.size());
+        sum += (m_weights[i] * *(begin + static_cast<typename IT::difference_type>(i)));
+    }
+    return m_af(sum);
+}
+
+template<typename IT>
+NeuronType Neuron::feedCompressed(IT begin, const uint32_t* columns, const NeuronType* values, size_t count) const {
+    neuropia_assert(m_af);
+    NeuronType sum = m_bias;
+    for(size_t i = 0; i < count; i++) {
+        sum += (values[i] * *(begin + static_cast<typename IT::difference_type>(columns[i])));
+    }
+    return m_af(sum);
+}
+
+template<typename IT>
+NeuronType Neuron::feed(IT begin, IT end, NeuronType scale, NeuronType offset) const {
+    neuropia_assert(m_af);
+    using Diff = typename std::iterator_traits<IT>::difference_type;
+    const auto sz = static_cast<size_t>(std::distance(begin, end));
+    neuropia_assert(m_weights.size() >= sz);
+    // independent partial sums, a single sum would wait each addition
+    NeuronType sums[4] = {0, 0, 0, 0};
+    size_t i = 0;
+    for(; i + 4 <= sz; i += 4) {
+        for(size_t j = 0; j < 4; j++)
+            sums[j] += (m_weights[i + j] * static_cast<NeuronType>(*(begin + static_cast<Diff>(i + j))));
+    }
+    for(; i < sz; i++) {
+        sums[0] += (m_weights[i] * static_cast<NeuronType>(*(begin + static_cast<Diff>(i))));
+    }
+    auto sum = ((sums[0] + sums[1]) + (sums[2] + sums[3])) * scale;
+    if(offset != 0) {
+        sum += offset * std::accumulate(m_weights.begin(), m_weights.begin() + static_cast<long>(sz), NeuronType{0});
+    }
+    return m_af(m_bias + sum);
+}
+
     template<typename IT>
     const ValueVector& Layer::feed(IT begin, IT end) const {
+        feedLayer(begin, end);
+        return feedForward();
+    }
+
+    template<typename IT>
+    void Layer::feedLayer(IT begin, IT end) const {
         neuropia_assert(m_activationFunction);
         if(!isInput()) {
             neuropia_assert(m_outBuffer.size() >= m_neurons.size());
-            for(size_t i = 0; i < m_neurons.size(); i++) {
-                const auto& n = m_neurons[i];
-                neuropia_assert(n.isActive());
-                m_outBuffer[i] = n.feed(begin, end);
+            const auto sparse = !m_csr && sparseInputs(begin, end);
+            feedNeurons(begin, end, sparse, 0, m_neurons.size());
+            if(m_activationFunction == softmaxFunction) {
+                softmax(m_outBuffer.begin(), m_outBuffer.begin() + static_cast<long>(m_neurons.size()));
             }
         } else {
             neuropia_assert(static_cast<size_t>(std::distance(begin, end)) <= m_outBuffer.size());
             std::copy(begin, end, m_outBuffer.begin());
         }
-        if(m_next != nullptr) {
-            return m_next->feed(m_outBuffer.begin(), m_outBuffer.end());
+    }
+
+    template<typename IT>
+    void Layer::feedNeurons(IT begin, IT end, bool sparse, size_t first, size_t last) const {
+        if(m_csr) {
+            const auto& csr = *m_csr;
+            for(size_t i = first; i < last; i++) {
+                const auto& n = m_neurons[i];
+                neuropia_assert(n.isActive());
+                const auto offset = csr.offsets[i];
+                m_outBuffer[i] = n.feedCompressed(begin, csr.columns.data() + offset, csr.values.data() + offset, csr.offsets[i + 1] - offset);
+            }
+        } else {
+            for(size_t i = first; i < last; i++) {
+                const auto& n = m_neurons[i];
+                neuropia_assert(n.isActive());
+                m_outBuffer[i] = sparse ? n.feedSparse(begin, m_nonZero) : n.feed(begin, end);
+            }
+        }
+    }
+
+    template<typename IT>
+    const ValueVector& Layer::feed(IT begin, IT end, ThreadPool& pool, size_t minWork) const {
+        neuropia_assert(isInput());
+        feedLayer(begin, end);
+        return feedForward(pool, minWork);
+    }
+
+    template<typename IT>
+    const ValueVector& Layer::feed(IT begin, IT end, NeuronType scale, NeuronType offset, ThreadPool& pool, size_t minWork) const {
+        neuropia_assert(isInput() && static_cast<size_t>(std::distance(begin, end)) <= m_outBuffer.size());
+        std::transform(begin, end, m_outBuffer.begin(), [scale, offset](const auto& value) {return static_cast<NeuronType>(value) * scale + offset;});
+        return feedForward(pool, minWork);
+    }
+
+    template<typename IT>
+    const ValueVector& Layer::feed(IT begin, IT end, NeuronType scale, NeuronType offset) const {
+        neuropia_assert(isInput() && m_next);
+        // the input layer is passed, the first layer is fed directly
+        const auto& layer = *m_next;
+        neuropia_assert(layer.m_outBuffer.size() >= layer.m_neurons.size());
+        for(size_t i = 0; i < layer.m_neurons.size(); i++) {
+            const auto& n = layer.m_neurons[i];
+            neuropia_assert(n.isActive());
+            layer.m_outBuffer[i] = n.feed(begin, end, scale, offset);
+        }
+        if(layer.m_activationFunction == softmaxFunction) {
+            softmax(layer.m_outBuffer.begin(), layer.m_outBuffer.begin() + static_cast<long>(layer.m_neurons.size()));
         }
-        return  m_outBuffer;
+        return layer.feedForward();
     }
 
 }
@@ -0,0 +1,199 @@
+#ifndef NEUROPIA_BINARY_H
+#define NEUROPIA_BINARY_H
+
+#include "neuropia.h"
+#include <cstdint>
+#include <limits>
+
+namespace Neuropia {
+
+/**
+ * @brief popcount
+ * @param value
+ * @return number of set bits
+ */
+inline unsigned popcount(uint32_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_popcount(value));
+#else
+    value = value - ((value >> 1) & 0x55555555U);
+    value = (value & 0x33333333U) + ((value >> 2) & 0x33333333U);
+    return (((value + (value >> 4)) & 0x0F0F0F0FU) * 0x01010101U) >> 24;
+#endif
+}
+
+/**
+ * @brief The BinaryNetwork class is a read only binarized network. Weights are stored as sign bits, and each neuron
+ * has a scale that is the mean magnitude of its weights. Inputs and activations of hidden layers are bits as well,
+ * hence dot products are XNOR or AND and popcount, and hidden neurons just compare the count to a threshold that folds
+ * in the scale, the bias and the activation. Only the outputs are real numbers.
+ *
+ * Hidden layers of signumFunction have -1 or +1 activations, binaryFunction and sigmoidFunction 0 or 1, where sigmoid
+ * is approximated as a step. Inputs are 0 or 1 by a byte threshold.
+ */
+class BinaryNetwork {
+public:
+    /// @brief Bits in a weight or activation word
+    static constexpr size_t WordBits = 32;
+
+    /// @brief Binarized layer
+    struct Layer {
+        /// @brief number of inputs
+        uint32_t inputs;
+        /// @brief number of neurons
+        uint32_t neurons;
+        /// @brief inputs are -1 and +1, else 0 and 1
+        bool signedInputs;
+        /// @brief hidden neuron activates when the count is below its threshold, else when at or above
+        bool inverted;
+        /// @brief sign bits, set for a positive weight, words() per neuron, unused bits are zero
+        std::vector<uint32_t> weights;
+        /// @brief thresholds of hidden neurons
+        std::vector<int32_t> thresholds;
+        /// @brief weight scales of output neurons
+        std::vector<float> scales;
+        /// @brief biases of output neurons
+        std::vector<float> biases;
+        /// @brief words per neuron
+        size_t words() const {return (inputs + WordBits - 1) / WordBits;}
+    };
+
+    /**
+     * @brief convert
+     * @param network trained network, hidden layers have to be of signumFunction, binaryFunction or sigmoidFunction
+     * @param inputThreshold bytes at or above are 1
+     * @return binarized network, nullopt if network cannot be binarized
+     */
+    static std::optional<BinaryNetwork> convert(const Neuropia::Layer& network, uint8_t inputThreshold = 128);
+
+    /**
+     * @brief load
+     * @param filename
+     * @return network, nullopt if file cannot be read
+     */
+    static std::optional<BinaryNetwork> load(const std::string& filename);
+
+    /**
+     * @brief load
+     * @param bytes
+     * @param sz
+     * @return network, nullopt if data is not valid
+     */
+    static std::optional<BinaryNetwork> load(const uint8_t* bytes, size_t sz);
+
+    /**
+     * @brief save
+     * @param filename
+     * @return false if file cannot be written
+     */
+    bool save(const std::string& filename) const;
+
+    /**
+     * @brief feed
+     * @param begin of input bytes
+     * @param end
+     * @return output values, scaled dot products plus biases i.e. outputs before their activation
+     */
+    template<typename IT>
+    const std::vector<float>& feed(IT begin, IT end) const;
+
+    /**
+     * @brief inSize
+     * @return number of inputs
+     */
+    size_t inSize() const {return m_layers.empty() ? 0 : m_layers.front().inputs;}
+
+    /**
+     * @brief outSize
+     * @return number of outputs
+     */
+    size_t outSize() const {return m_layers.empty() ? 0 : m_layers.back().neurons;}
+
+    /**
+     * @brief layers
+     * @return layers after the input
+     */
+    const std::vector<Layer>& layers() const {return m_layers;}
+
+    /**
+     * @brief inputThreshold
+     * @return
+     */
+    uint8_t inputThreshold() const {return m_inputThreshold;}
+
+    /**
+     * @brief bytes
+     * @return size of weights, thresholds, scales and biases
+     */
+    size_t bytes() const;
+
+    /// @brief Dot product kernels, Auto is the one selected for the CPU at run time
+    enum class Kernel {Auto, Default, Popcnt, Vpopcnt};
+
+    /**
+     * @brief supports
+     * @param kernel
+     * @return true if the kernel can run on this CPU
+     */
+    static bool supports(Kernel kernel);
+
+    /**
+     * @brief dots, dot products of the layer neurons and bits
+     * @param layer
+     * @param bits inputs of the layer, words() of them
+     * @param setBits number of set bits
+     * @param counts dot product per neuron
+     * @param kernel has to be supported
+     */
+    static void dots(const Layer& layer, const uint32_t* bits, int setBits, int* counts, Kernel kernel = Kernel::Auto);
+
+private:
+    BinaryNetwork() = default;
+
+private:
+    std::vector<Layer> m_layers = {};
+    uint8_t m_inputThreshold = 128;
+    mutable std::vector<uint32_t> m_inBits = {};
+    mutable std::vector<uint32_t> m_outBits = {};
+    mutable std::vector<float> m_outputs = {};
+    mutable std::vector<int> m_counts = {};
+};
+
+template<typename IT>
+const std::vector<float>& BinaryNetwork::feed(IT begin, IT end) const {
+    neuropia_assert(!m_layers.empty() && static_cast<size_t>(std::distance(begin, end)) == inSize());
+    // bits are set without branches, input bytes are not predictable
+    m_inBits.assign(m_layers.front().words(), 0);
+    int setBits = 0;
+    size_t index = 0;
+    for(auto it = begin; it != end; ++it, ++index) {
+        const auto bit = static_cast<uint32_t>(static_cast<uint8_t>(*it) >= m_inputThreshold);
+        m_inBits[index / WordBits] |= bit << (index % WordBits);
+        setBits += static_cast<int>(bit);
+    }
+    for(auto l = 0U; l + 1 < m_layers.size(); l++) {
+        const auto& layer = m_layers[l];
+        m_counts.resize(layer.neurons);
+        dots(layer, m_inBits.data(), setBits, m_counts.data());
+        m_outBits.assign((layer.neurons + WordBits - 1) / WordBits, 0);
+        int outSetBits = 0;
+        for(auto i = 0U; i < layer.neurons; i++) {
+            const auto bit = static_cast<uint32_t>((m_counts[i] >= layer.thresholds[i]) != layer.inverted);
+            m_outBits[i / WordBits] |= bit << (i % WordBits);
+            outSetBits += static_cast<int>(bit);
+        }
+        m_inBits.swap(m_outBits);
+        setBits = outSetBits;
+    }
+    const auto& out = m_layers.back();
+    m_counts.resize(out.neurons);
+    dots(out, m_inBits.data(), setBits, m_counts.data());
+    m_outputs.resize(out.neurons);
+    for(auto i = 0U; i < out.neurons; i++) {
+        m_outputs[i] = out.scales[i] * static_cast<float>(m_counts[i]) + out.biases[i];
+    }
+    return m_outputs;
+}
+}
+
+#endif // NEUROPIA_BINARY_H
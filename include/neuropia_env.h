@@ -1,6 +1,7 @@
 #pragma once
 #include "default.h"
 #include "neuropia.h"
+#include "profiler.h"
 #include "params.h"
 #include "logstream.h"
 #include <iostream>
@@ -15,6 +16,7 @@ public:
         m_params.addHelp( topologyRe, "\',\'-separated list of integers");
         m_params.addHelp( activationFunctionRe, "\',\'-separated list of activation functions: \"sigmoid, relu or elu\"");
         m_params.addHelp( dropoutRateRe, "\',\'-separated of list of real numbers");
+        m_params.addHelp( freezeRe, "\',\'-separated list of 0 or 1 per layer, starting from the first hidden layer");
     }
     virtual ~NeuropiaEnv();
     void setLogger(std::function<void (const std::string&)> logger) {
@@ -29,6 +31,7 @@ public:
         m_prevStreamBufCerr = std::cerr.rdbuf(m_logStream.get());
     }
     Neuropia::Layer m_network = {};
+    Neuropia::Profiler::Stats m_profile = {};
     Neuropia::Params m_params = {
         DEFAULT_PARAMS
 };
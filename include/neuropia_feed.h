@@ -134,6 +134,10 @@ namespace Neuropia {
                 return reLuFunction;
             else if (eluFunction.name() == name)
                 return eluFunction;
+            else if (softmaxFunction.name() == name)
+                return softmaxFunction;
+            else if (linearFunction.name() == name)
+                return linearFunction;
             else
                 return ActivationFunction{};
         }
@@ -189,6 +193,13 @@ namespace Neuropia {
 
 
 
+        static constexpr size_t max_layer_size() {
+            size_t sz = 0;
+            for(auto i = 1U; i < layer_count(); ++i)
+                sz = std::max(sz, std::get<LAYER_SIZE>(get_layer_info(i)));
+            return sz;
+        }
+
         template<typename IT>
         static SType feed_neuron(const Neuron& neuron, IT begin, IT end, const ActivationFunction& activation_function) {
             auto sum = read_real(std::get<NEURON_BIAS>(neuron));
@@ -198,10 +209,28 @@ namespace Neuropia {
                 sum += (read_real(pos) * *(begin + i));
                 pos += sizeof(SType);
             }
-            return activation_function(sum);
+            return static_cast<SType>(activation_function(sum));
         }    
 
 
+        template<typename IT>
+        static SType feed_neuron(const Neuron& neuron, IT begin, IT end, SType scale, SType offset, const ActivationFunction& activation_function) {
+            // normalization is folded, sum(w * (x * s + o)) = s * sum(w * x) + o * sum(w)
+            SType product = 0;
+            SType weight = 0;
+            const auto sz = std::distance(begin, end);
+            auto pos = std::get<NEURON_WEIGHTS>(neuron).first;
+            for(auto i = 0; i < sz; ++i) {
+                const auto w = read_real(pos);
+                product += w * static_cast<SType>(*(begin + i));
+                if(offset != 0)
+                    weight += w;
+                pos += sizeof(SType);
+            }
+            return static_cast<SType>(activation_function(read_real(std::get<NEURON_BIAS>(neuron)) + scale * product + offset * weight));
+        }
+
+
     public:
         using OutValues = std::array<SType, out_layer_size()>;            
         template<typename IT>
@@ -214,7 +243,32 @@ namespace Neuropia {
          */
         static OutValues feed(IT begin, IT end) {
             static_assert(std::is_same<typename std::iterator_traits<IT>::value_type, SType>::value);
-            std::array<SType, std::get<LAYER_SIZE>(get_layer_info(1))> a_buffer; // - a buffer is 1st write buffer... the maximum buffer size as next layer < previous, and input is outside
+            return feed_layers([begin, end](const Neuron& neuron, const ActivationFunction& activation_function) {
+                return feed_neuron(neuron, begin, end, activation_function);
+            });
+        }
+
+        template<typename IT>
+        /**
+         * @brief Feed neural network with raw bytes, normalization is done within the first layer
+         * 
+         * @param begin 
+         * @param end 
+         * @param scale input is normalized as value * scale + offset, e.g. 1 / 255
+         * @param offset 
+         * @return OutValues 
+         */
+        static OutValues feed(IT begin, IT end, SType scale, SType offset = 0) {
+            static_assert(std::is_same<typename std::iterator_traits<IT>::value_type, uint8_t>::value);
+            return feed_layers([begin, end, scale, offset](const Neuron& neuron, const ActivationFunction& activation_function) {
+                return feed_neuron(neuron, begin, end, scale, offset, activation_function);
+            });
+        }
+
+    private:
+        template<typename F>
+        static OutValues feed_layers(F first_neuron) {
+            std::array<SType, max_layer_size()> a_buffer; // - a buffer is 1st write buffer, input is outside
             const auto af_1 = name_to_function(std::get<LAYER_ACTIVATION>(get_layer_info(1)));
             constexpr auto off_1 = std::get<LAYER_NEURONS>(get_layer_info(1)); // 0 is input layer , structured bind cannot be constexpr
             auto it = a_buffer.begin();
@@ -222,12 +276,15 @@ namespace Neuropia {
             while(pos < off_1.second) {
                 const auto neuron = make_neuron_info(pos);
                 pos = std::get<NEURON_WEIGHTS>(neuron).second;
-                const auto result = feed_neuron(neuron, begin, end, af_1);
+                const auto result = first_neuron(neuron, af_1);
                 *it = result;
                 ++it;
             }
+            if(af_1 == softmaxFunction) {
+                softmax(a_buffer.begin(), it);
+            }
             
-            std::array<SType, std::get<LAYER_SIZE>(get_layer_info(2))> b_buffer; // the maximum buffer size as next layer < previous, and input is outside
+            std::array<SType, max_layer_size()> b_buffer; // layers are not necessarily decreasing, e.g. a factorized layer is narrower than the next
             
             auto write_begin = b_buffer.begin();
             auto read_begin = a_buffer.begin();
@@ -245,6 +302,9 @@ namespace Neuropia {
                     *it = result;
                     ++it;
                 }
+                if(activation_function == softmaxFunction) {
+                    softmax(write_begin, it);
+                }
                 std::swap(write_begin, read_begin);
                 read_end = it; // this is where the last write ended!
             }
@@ -254,6 +314,8 @@ namespace Neuropia {
             return out;
         }
 
+
+    public:
     /**
      * @brief get a layer info 
      * 
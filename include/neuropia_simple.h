@@ -9,6 +9,7 @@
 #include <variant>
 #include <functional>
 #include "neuropia.h"
+#include "profiler.h"
 
 
 /**
@@ -130,6 +131,14 @@ int verify(const NeuropiaPtr& env);
  */
 void setLogger(const NeuropiaPtr& env, std::function<void (const std::string&) > call_back);
 
+/**
+ * @brief Time and count per training phase of the latest training, collected if Profile parameter is set.
+ * 
+ * @param env 
+ * @return Neuropia::Profiler::Stats, Neuropia::Profiler::Phase is the index
+ */
+Neuropia::Profiler::Stats profile(const NeuropiaPtr& env);
+
  /**
  * @brief Access to Neuropia network input layer
  * 
@@ -0,0 +1,259 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+
+#ifndef NEUROPIA_TYPE
+#define NEUROPIA_TYPE double
+#endif
+
+namespace Neuropia {
+using NeuronType = NEUROPIA_TYPE;
+
+/**
+ * @brief The Optimizer class turns gradients into parameter updates.
+ * Update kernels are plain loops over contiguous arrays so that the compiler can vectorize them.
+ */
+class Optimizer {
+public:
+    /// @brief Optimization algorithms
+    enum class Type : uint8_t {Sgd, Momentum, Nesterov, RMSProp, Adam};
+
+    Optimizer() = default;
+
+    /**
+     * @brief Optimizer
+     * @param type
+     * @param momentum momentum for Momentum and Nesterov, decay of first moment (beta1) for Adam
+     * @param beta2 decay of second moment for RMSProp and Adam
+     */
+    Optimizer(Type type, NeuronType momentum, NeuronType beta2) noexcept : m_type(type), m_momentum(momentum), m_beta2(beta2) {}
+
+    /**
+     * @brief type
+     * @return
+     */
+    Type type() const {return m_type;}
+
+    /**
+     * @brief stateCount
+     * @return number of state values needed per parameter
+     */
+    unsigned stateCount() const {
+        switch(m_type) {
+        case Type::Sgd: return 0;
+        case Type::Momentum:
+        case Type::Nesterov:
+        case Type::RMSProp: return 1;
+        case Type::Adam: return 2;
+        default: return 0;
+        }
+    }
+
+    /**
+     * @brief update turns gradients to parameter updates in place and updates the state
+     * @param gradients
+     * @param first state, can be nullptr if stateCount is 0
+     * @param second state, can be nullptr if stateCount is less than 2
+     * @param count length of arrays
+     * @param learningRate
+     * @param step number of updates done including this, starts from 1
+     */
+    void update(NeuronType* __restrict gradients, NeuronType* __restrict first, NeuronType* __restrict second,
+                size_t count, NeuronType learningRate, unsigned step) const noexcept {
+        const auto mu = m_momentum;
+        const auto b2 = m_beta2;
+        switch(m_type) {
+        case Type::Sgd:
+            for(size_t i = 0; i < count; i++) {
+                gradients[i] *= learningRate;
+            }
+            break;
+        case Type::Momentum:
+            for(size_t i = 0; i < count; i++) {
+                first[i] = mu * first[i] + learningRate * gradients[i];
+                gradients[i] = first[i];
+            }
+            break;
+        case Type::Nesterov:
+            for(size_t i = 0; i < count; i++) {
+                const auto prev = first[i];
+                first[i] = mu * first[i] + learningRate * gradients[i];
+                gradients[i] = (1 + mu) * first[i] - mu * prev;
+            }
+            break;
+        case Type::RMSProp:
+            for(size_t i = 0; i < count; i++) {
+                first[i] = b2 * first[i] + (1 - b2) * gradients[i] * gradients[i];
+                gradients[i] = learningRate * gradients[i] / (std::sqrt(first[i]) + Epsilon);
+            }
+            break;
+        case Type::Adam: {
+            // bias corrections are folded into the step size
+            const auto c1 = 1 - std::pow(mu, static_cast<NeuronType>(step));
+            const auto c2 = 1 - std::pow(b2, static_cast<NeuronType>(step));
+            const auto a = learningRate * std::sqrt(c2) / c1;
+            const auto e = Epsilon * std::sqrt(c2);
+            for(size_t i = 0; i < count; i++) {
+                first[i] = mu * first[i] + (1 - mu) * gradients[i];
+                second[i] = b2 * second[i] + (1 - b2) * gradients[i] * gradients[i];
+                gradients[i] = a * first[i] / (std::sqrt(second[i]) + e);
+            }
+        }
+            break;
+        default:
+            break;
+        }
+    }
+
+private:
+    static constexpr NeuronType Epsilon = static_cast<NeuronType>(1e-8);
+    Type m_type = Type::Sgd;
+    NeuronType m_momentum = static_cast<NeuronType>(0.9);
+    NeuronType m_beta2 = static_cast<NeuronType>(0.999);
+};
+
+/**
+ * @brief The OptimizerState class keeps the per parameter state of an Optimizer. The state values are shared by
+ * copies of the state, as SharedVector, and copied only when either is updated.
+ */
+class OptimizerState {
+public:
+    /**
+     * @brief prepare for the next update
+     * @param count number of parameters
+     * @param states Optimizer::stateCount
+     */
+    void prepare(size_t count, unsigned states) {
+        ++m_step;
+        if(states == 0 && !m_values) {
+            return;
+        }
+        auto& values = write();
+        values.first.resize(states > 0 ? count : 0);
+        values.second.resize(states > 1 ? count : 0);
+    }
+
+    /**
+     * @brief first
+     * @param offset
+     * @return first state values starting from offset, nullptr if not used
+     */
+    NeuronType* first(size_t offset) {return m_values && !m_values->first.empty() ? write().first.data() + offset : nullptr;}
+
+    /**
+     * @brief second
+     * @param offset
+     * @return second state values starting from offset, nullptr if not used
+     */
+    NeuronType* second(size_t offset) {return m_values && !m_values->second.empty() ? write().second.data() + offset : nullptr;}
+
+    /**
+     * @brief step
+     * @return number of updates
+     */
+    unsigned step() const {return m_step;}
+
+    /**
+     * @brief merge, as Layer::merge states are weighted
+     * @param other
+     * @param factor
+     */
+    void merge(const OptimizerState& other, NeuronType factor) {
+        const auto& first = values().first;
+        const auto& second = values().second;
+        const auto& otherFirst = other.values().first;
+        const auto& otherSecond = other.values().second;
+        if(first.size() == otherFirst.size() && second.size() == otherSecond.size()) {
+            if(!first.empty() || !second.empty()) {
+                auto& values = write();
+                for(size_t i = 0; i < values.first.size(); i++) {
+                    values.first[i] = values.first[i] * (1 - factor) + otherFirst[i] * factor;
+                }
+                for(size_t i = 0; i < values.second.size(); i++) {
+                    values.second[i] = values.second[i] * (1 - factor) + otherSecond[i] * factor;
+                }
+            }
+        } else if(first.empty()) {
+            m_values = other.m_values;
+            m_step = other.m_step;
+        }
+        m_step = std::max(m_step, other.m_step);
+    }
+
+    /**
+     * @brief average, as Layer::mergeAll states are a weighted sum, states of other sizes than the first are not used
+     * @param states
+     * @param factors per state
+     */
+    void average(const std::vector<const OptimizerState*>& states, const std::vector<NeuronType>& factors) {
+        const auto& front = states.front()->values();
+        m_step = 0;
+        for(const auto state : states) {
+            m_step = std::max(m_step, state->m_step);
+        }
+        if(front.first.empty() && front.second.empty()) {
+            m_values.reset();
+            return;
+        }
+        Values sum;
+        sum.first.assign(front.first.size(), 0);
+        sum.second.assign(front.second.size(), 0);
+        for(size_t s = 0; s < states.size(); s++) {
+            const auto& state = states[s]->values();
+            if(state.first.size() == sum.first.size() && state.second.size() == sum.second.size()) {
+                for(size_t i = 0; i < sum.first.size(); i++) {
+                    sum.first[i] += state.first[i] * factors[s];
+                }
+                for(size_t i = 0; i < sum.second.size(); i++) {
+                    sum.second[i] += state.second[i] * factors[s];
+                }
+            }
+        }
+        m_values = std::make_shared<Values>(std::move(sum));
+    }
+
+    /**
+     * @brief clear
+     */
+    void clear() {
+        m_values.reset();
+        m_step = 0;
+    }
+
+private:
+    struct Values {
+        std::vector<NeuronType> first = {};
+        std::vector<NeuronType> second = {};
+    };
+
+    const Values& values() const {
+        static const Values empty = {};
+        return m_values ? *m_values : empty;
+    }
+
+    // values that are not shared with any copy
+    Values& write() {
+        if(!m_values) {
+            m_values = std::make_shared<Values>();
+        } else if(m_values.use_count() > 1) {
+            m_values = std::make_shared<Values>(*m_values);
+        } else {
+            // copies released in other threads are done with the values before they are written
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return *m_values;
+    }
+
+private:
+    std::shared_ptr<Values> m_values = nullptr;
+    unsigned m_step = 0;
+};
+}
+
+#endif // OPTIMIZER_H
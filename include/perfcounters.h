@@ -0,0 +1,135 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace Neuropia {
+
+/**
+ * @brief The PerfCounters class reads hardware performance counters of the calling thread.
+ * Counters are read using perf_event_open on Linux, elsewhere or if the counters are not permitted
+ * (see /proc/sys/kernel/perf_event_paranoid) they are not available and all values are zero.
+ */
+class PerfCounters {
+public:
+    /// @brief Counter values
+    struct Counts {
+        uint64_t cycles;
+        uint64_t instructions;
+        uint64_t cacheMisses;
+        uint64_t branchMisses;
+
+        Counts& operator+=(const Counts& other) {
+            cycles += other.cycles;
+            instructions += other.instructions;
+            cacheMisses += other.cacheMisses;
+            branchMisses += other.branchMisses;
+            return *this;
+        }
+
+        friend Counts operator-(const Counts& a, const Counts& b) {
+            return {a.cycles - b.cycles, a.instructions - b.instructions, a.cacheMisses - b.cacheMisses, a.branchMisses - b.branchMisses};
+        }
+    };
+
+    /**
+     * @brief thread
+     * @return counters of the calling thread, opened on first use
+     */
+    static PerfCounters& thread() {
+        thread_local PerfCounters counters;
+        return counters;
+    }
+
+    /**
+     * @brief available
+     * @return true if counters can be read
+     */
+    bool available() const {return m_available;}
+
+    /**
+     * @brief read
+     * @return current counter values since the thread counters were opened
+     */
+    Counts read() const {
+#if defined(__linux__)
+        if(m_available) {
+            struct {uint64_t nr; uint64_t values[EventCount];} data = {};
+            if(::read(m_fds[0], &data, sizeof(data)) == static_cast<ssize_t>(sizeof(data)) && data.nr == EventCount) {
+                return {data.values[0], data.values[1], data.values[2], data.values[3]};
+            }
+        }
+#endif
+        return {0, 0, 0, 0};
+    }
+
+    ~PerfCounters() {
+#if defined(__linux__)
+        for(const auto fd : m_fds) {
+            if(fd >= 0)
+                ::close(fd);
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+private:
+    PerfCounters() {
+#if defined(__linux__)
+        constexpr uint64_t Events[EventCount] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                 PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for(auto i = 0U; i < EventCount; i++) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = Events[i];
+            attr.disabled = i == 0 ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            m_fds[i] = static_cast<int>(::syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : m_fds[0], 0));
+            if(m_fds[i] < 0) {
+                notAvailable(std::strerror(errno));
+                return;
+            }
+        }
+        if(::ioctl(m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) < 0) {
+            notAvailable(std::strerror(errno));
+            return;
+        }
+        m_available = true;
+#else
+        notAvailable("not supported on this platform");
+#endif
+    }
+
+    static void notAvailable(const char* reason) {
+        static std::once_flag once;
+        std::call_once(once, [reason]() {
+            std::cerr << "Hardware performance counters are not available: " << reason << std::endl;
+        });
+    }
+
+private:
+    static constexpr unsigned EventCount = 4;
+    std::array<int, EventCount> m_fds = {-1, -1, -1, -1};
+    bool m_available = false;
+};
+}
+
+#endif // PERFCOUNTERS_H
@@ -0,0 +1,142 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+namespace Neuropia {
+
+/**
+ * @brief The Philox class is Philox4x32-10 counter based random number generator (Salmon et al., 2011).
+ * Output is a function of a key and a counter only, hence independent streams are derived from one
+ * run seed just by giving each a different stream id, and creating a stream costs nothing.
+ * Meets UniformRandomBitGenerator requirements, so it can be used with <random> distributions.
+ */
+class Philox {
+public:
+    using result_type = uint32_t;
+
+    /// @brief Stream families, each is divided further by an index
+    enum class Stream : uint16_t {Thread = 1, Sampling, Dropout, Initialize};
+
+    /**
+     * @brief Philox
+     * @param key
+     * @param stream
+     */
+    explicit Philox(uint64_t key = 0, uint64_t stream = 0) noexcept :
+        m_key{static_cast<uint32_t>(key), static_cast<uint32_t>(key >> 32)},
+        m_counter{0, 0, static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)} {}
+
+    static constexpr result_type min() {return 0;}
+    static constexpr result_type max() {return std::numeric_limits<result_type>::max();}
+
+    /**
+     * @brief operator ()
+     * @return next number of the stream
+     */
+    result_type operator()() noexcept {
+        if(m_index == m_block.size()) {
+            m_block = block(m_counter, m_key);
+            if(++m_counter[0] == 0)
+                ++m_counter[1];
+            m_index = 0;
+        }
+        return m_block[m_index++];
+    }
+
+    /**
+     * @brief block
+     * @param counter
+     * @param key
+     * @return four numbers of the counter
+     */
+    static std::array<uint32_t, 4> block(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key) noexcept {
+        constexpr uint32_t M0 = 0xD2511F53;
+        constexpr uint32_t M1 = 0xCD9E8D57;
+        constexpr uint32_t W0 = 0x9E3779B9;
+        constexpr uint32_t W1 = 0xBB67AE85;
+        for(auto round = 0U; round < 10; round++) {
+            const auto p0 = static_cast<uint64_t>(M0) * counter[0];
+            const auto p1 = static_cast<uint64_t>(M1) * counter[2];
+            counter = {static_cast<uint32_t>(p1 >> 32) ^ counter[1] ^ key[0], static_cast<uint32_t>(p1),
+                       static_cast<uint32_t>(p0 >> 32) ^ counter[3] ^ key[1], static_cast<uint32_t>(p0)};
+            key[0] += W0;
+            key[1] += W1;
+        }
+        return counter;
+    }
+
+    /**
+     * @brief setSeed
+     * @param seed of the run, all streams are derived from it. Set before streams are created, run ids start again.
+     */
+    static void setSeed(uint64_t seed) {s_seed = seed; s_runs = 0;}
+
+    /**
+     * @brief seed
+     * @return seed of the run, if not set it is RANDOM_SEED or the clock at start
+     */
+    static uint64_t seed() {return s_seed;}
+
+    /**
+     * @brief stream
+     * @param family
+     * @param index
+     * @return generator of the run seed and the stream
+     */
+    static Philox stream(Stream family, uint64_t index = 0) {
+        return Philox(seed(), (static_cast<uint64_t>(family) << 48) ^ index);
+    }
+
+    /**
+     * @brief stream
+     * @param family
+     * @param run id, see run()
+     * @param index within the run, e.g. layer depth or job
+     * @return generator of the run seed and the stream
+     */
+    static Philox stream(Stream family, uint64_t run, uint64_t index) {
+        return stream(family, (run << 32) ^ index);
+    }
+
+    /**
+     * @brief run
+     * @return id of a new run, e.g. a network initialization or a training, so that networks and trainings of one
+     * process get different streams. Ids are counted from the seed, hence a process of the same seed is reproducible.
+     */
+    static uint64_t run() {return s_runs++;}
+
+    /**
+     * @brief thread
+     * @return generator of the calling thread, each thread has own stream unless reassigned for reproducibility
+     */
+    static Philox& thread() {
+        static std::atomic<uint64_t> threads{0};
+        thread_local Philox gen = stream(Stream::Thread, threads++);
+        return gen;
+    }
+
+private:
+    static uint64_t defaultSeed() {
+#ifndef RANDOM_SEED
+        return static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+#else
+        return RANDOM_SEED;
+#endif
+    }
+
+private:
+    std::array<uint32_t, 2> m_key;
+    std::array<uint32_t, 4> m_counter;
+    std::array<uint32_t, 4> m_block = {};
+    size_t m_index = 4;
+    static inline std::atomic<uint64_t> s_seed{defaultSeed()};
+    static inline std::atomic<uint64_t> s_runs{0};
+};
+}
+
+#endif // PHILOX_H
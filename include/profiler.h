@@ -0,0 +1,256 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <iomanip>
+#include "perfcounters.h"
+
+namespace Neuropia {
+
+/**
+ * @brief The Profiler class accumulates time and counts per training phase.
+ * Phases can be recorded concurrently from training threads, hence their times are
+ * summed over the threads and may exceed the wall time.
+ * Optionally hardware performance counters are sampled around the forward, backward and merge phases.
+ */
+class Profiler {
+public:
+    /// @brief Training phases
+    enum class Phase : uint8_t {Sampling, Io, Normalization, Forward, Backward, Merge, Verify};
+    /// @brief Number of phases
+    static constexpr size_t PhaseCount = 7;
+
+    /// @brief Accumulated phase
+    struct Stat {
+        /// @brief time spent
+        std::chrono::nanoseconds time;
+        /// @brief number of times done
+        size_t count;
+        /// @brief hardware counters, zero if not sampled
+        PerfCounters::Counts counters;
+    };
+
+    /// @brief Stats per phase, Phase is the index
+    using Stats = std::array<Stat, PhaseCount>;
+
+    /**
+     * @brief The Scope class records the phase time on its lifetime
+     */
+    class Scope {
+    public:
+        Scope(Profiler* profiler, Phase phase) noexcept : m_profiler(profiler), m_phase(phase),
+            m_sampled(profiler && profiler->m_counters && isSampled(phase)),
+            m_counts(m_sampled ? PerfCounters::thread().read() : PerfCounters::Counts{0, 0, 0, 0}),
+            m_start(profiler ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{}) {}
+        ~Scope() {
+            if(m_profiler) {
+                m_profiler->add(m_phase, std::chrono::steady_clock::now() - m_start);
+                if(m_sampled)
+                    m_profiler->add(m_phase, PerfCounters::thread().read() - m_counts);
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        Profiler* const m_profiler;
+        const Phase m_phase;
+        const bool m_sampled;
+        const PerfCounters::Counts m_counts;
+        const std::chrono::steady_clock::time_point m_start;
+    };
+
+    Profiler() = default;
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    /**
+     * @brief scope
+     * @param phase
+     * @return a Scope that records the phase, nothing is recorded if profiler is not enabled
+     */
+    Scope scope(Phase phase) {return Scope(m_enabled ? this : nullptr, phase);}
+
+    /**
+     * @brief add
+     * @param phase
+     * @param time
+     * @param count
+     */
+    void add(Phase phase, std::chrono::nanoseconds time, size_t count = 1) noexcept {
+        auto& p = m_phases[static_cast<size_t>(phase)];
+        p.time.fetch_add(time.count(), std::memory_order_relaxed);
+        p.count.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief add hardware counters
+     * @param phase
+     * @param counts
+     */
+    void add(Phase phase, const PerfCounters::Counts& counts) noexcept {
+        auto& p = m_phases[static_cast<size_t>(phase)];
+        p.cycles.fetch_add(counts.cycles, std::memory_order_relaxed);
+        p.instructions.fetch_add(counts.instructions, std::memory_order_relaxed);
+        p.cacheMisses.fetch_add(counts.cacheMisses, std::memory_order_relaxed);
+        p.branchMisses.fetch_add(counts.branchMisses, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief enable
+     * @param enabled
+     */
+    void enable(bool enabled) {m_enabled = enabled;}
+
+    /**
+     * @brief enableCounters, sample hardware counters, if available, in forward, backward and merge phases
+     * @param enabled
+     */
+    void enableCounters(bool enabled) {
+        m_counters = enabled && PerfCounters::thread().available();
+    }
+
+    /**
+     * @brief isSampled
+     * @param phase
+     * @return true if hardware counters are sampled in the phase
+     */
+    static bool isSampled(Phase phase) {
+        return phase == Phase::Forward || phase == Phase::Backward || phase == Phase::Merge;
+    }
+
+    /**
+     * @brief isEnabled
+     * @return
+     */
+    bool isEnabled() const {return m_enabled;}
+
+    /**
+     * @brief stat
+     * @param phase
+     * @return
+     */
+    Stat stat(Phase phase) const {
+        const auto& p = m_phases[static_cast<size_t>(phase)];
+        return {std::chrono::nanoseconds(p.time.load(std::memory_order_relaxed)), p.count.load(std::memory_order_relaxed),
+                {p.cycles.load(std::memory_order_relaxed), p.instructions.load(std::memory_order_relaxed),
+                 p.cacheMisses.load(std::memory_order_relaxed), p.branchMisses.load(std::memory_order_relaxed)}};
+    }
+
+    /**
+     * @brief stats
+     * @return
+     */
+    Stats stats() const {
+        Stats s = {};
+        for(auto i = 0U; i < PhaseCount; i++)
+            s[i] = stat(static_cast<Phase>(i));
+        return s;
+    }
+
+    /**
+     * @brief reset
+     */
+    void reset() {
+        for(auto& p : m_phases) {
+            p.time = 0;
+            p.count = 0;
+            p.cycles = 0;
+            p.instructions = 0;
+            p.cacheMisses = 0;
+            p.branchMisses = 0;
+        }
+    }
+
+    /**
+     * @brief name
+     * @param phase
+     * @return
+     */
+    static std::string_view name(Phase phase) {
+        constexpr std::string_view Names[] = {"sampling", "io", "normalization", "forward", "backward", "merge", "verify"};
+        static_assert(sizeof(Names) / sizeof(Names[0]) == PhaseCount);
+        return Names[static_cast<size_t>(phase)];
+    }
+
+    /**
+     * @brief report
+     * @param stats
+     * @return stats as a human readable table, IPC and misses per count are shown for phases having hardware counters
+     */
+    static std::string report(const Stats& stats) {
+        std::chrono::nanoseconds total{0};
+        for(const auto& s : stats)
+            total += s.time;
+        std::ostringstream out;
+        out << std::fixed;
+        for(auto i = 0U; i < PhaseCount; i++) {
+            const auto& s = stats[i];
+            const auto seconds = std::chrono::duration<double>(s.time).count();
+            out << std::left << std::setw(14) << name(static_cast<Phase>(i)) << std::right
+                << std::setw(12) << std::setprecision(3) << seconds << "s"
+                << std::setw(7) << std::setprecision(1) << (total.count() > 0 ? 100.0 * static_cast<double>(s.time.count()) / static_cast<double>(total.count()) : 0.0) << "%"
+                << std::setw(12) << s.count
+                << std::setw(12) << std::setprecision(0) << (s.count > 0 ? static_cast<double>(s.time.count()) / static_cast<double>(s.count) : 0.0) << "ns";
+            if(s.counters.cycles > 0 && s.count > 0) {
+                const auto perCount = [&s](uint64_t v) {return static_cast<double>(v) / static_cast<double>(s.count);};
+                out << std::setw(8) << std::setprecision(2) << static_cast<double>(s.counters.instructions) / static_cast<double>(s.counters.cycles) << " IPC"
+                    << std::setw(10) << std::setprecision(1) << perCount(s.counters.cacheMisses) << " cache-misses"
+                    << std::setw(10) << perCount(s.counters.branchMisses) << " branch-misses";
+            }
+            out << '\n';
+        }
+        return out.str();
+    }
+
+private:
+    struct Counter {
+        std::atomic<int64_t> time{0};
+        std::atomic<size_t> count{0};
+        std::atomic<uint64_t> cycles{0};
+        std::atomic<uint64_t> instructions{0};
+        std::atomic<uint64_t> cacheMisses{0};
+        std::atomic<uint64_t> branchMisses{0};
+    };
+    std::array<Counter, PhaseCount> m_phases = {};
+    bool m_enabled = false;
+    bool m_counters = false;
+};
+
+/**
+ * @brief The Throttle class rate limits an operation, e.g. progress output
+ */
+class Throttle {
+public:
+    /**
+     * @brief Throttle
+     * @param interval minimum interval, zero lets everything through
+     */
+    explicit Throttle(std::chrono::milliseconds interval) : m_interval(interval) {}
+
+    /**
+     * @brief operator ()
+     * @return true if operation can be done now, i.e. the interval has passed since last true
+     */
+    bool operator()() {
+        if(m_interval.count() == 0)
+            return true;
+        const auto now = std::chrono::steady_clock::now();
+        if(now - m_last < m_interval)
+            return false;
+        m_last = now;
+        return true;
+    }
+
+private:
+    const std::chrono::milliseconds m_interval;
+    std::chrono::steady_clock::time_point m_last = {};
+};
+}
+
+#endif // PROFILER_H
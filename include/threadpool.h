@@ -0,0 +1,117 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+namespace Neuropia {
+
+/**
+ * @brief The ThreadPool class keeps threads waiting to run a range of work split in parts, the calling thread runs
+ * a part as well. Threads are started once, hence a short task does not pay thread start up.
+ */
+class ThreadPool {
+public:
+    /// @brief Task for a range of work items
+    using Task = std::function<void (size_t begin, size_t end)>;
+
+    /**
+     * @brief ThreadPool
+     * @param threads number of threads including the calling one, 0 is as many as the hardware has
+     */
+    explicit ThreadPool(unsigned threads = 0) {
+        const auto count = threads > 0 ? threads : std::max(1U, std::thread::hardware_concurrency());
+        for(auto i = 1U; i < count; i++) {
+            m_threads.emplace_back([this, i]() {work(i);});
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_start.notify_all();
+        for(auto& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    /**
+     * @brief size
+     * @return number of threads including the calling one
+     */
+    unsigned size() const {return static_cast<unsigned>(m_threads.size()) + 1;}
+
+    /**
+     * @brief run task for items 0 - count, split in size() consecutive ranges, returns when all are done.
+     * Not to be called from a task.
+     * @param count
+     * @param task
+     */
+    void run(size_t count, const Task& task) {
+        if(m_threads.empty() || count < 2) {
+            task(0, count);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_task = &task;
+            m_count = count;
+            m_pending = m_threads.size();
+            ++m_generation;
+        }
+        m_start.notify_all();
+        task(0, end(0));
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]() {return m_pending == 0;});
+        m_task = nullptr;
+    }
+
+private:
+    // end of range of part, the part begins where the previous ends
+    size_t end(size_t part) const {return (m_count * (part + 1)) / size();}
+
+    void work(size_t part) {
+        size_t generation = 0;
+        for(;;) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start.wait(lock, [this, generation]() {return m_stop || m_generation != generation;});
+            if(m_stop) {
+                return;
+            }
+            generation = m_generation;
+            const auto task = m_task;
+            const auto begin = end(part - 1);
+            const auto last = end(part);
+            lock.unlock();
+            (*task)(begin, last);
+            lock.lock();
+            if(--m_pending == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+
+private:
+    std::vector<std::thread> m_threads = {};
+    std::mutex m_mutex = {};
+    std::condition_variable m_start = {};
+    std::condition_variable m_done = {};
+    const Task* m_task = nullptr;
+    size_t m_count = 0;
+    size_t m_pending = 0;
+    size_t m_generation = 0;
+    bool m_stop = false;
+};
+
+}
+
+#endif // THREADPOOL_H
@@ -0,0 +1,151 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Neuropia {
+
+/**
+ * @brief The Trace class records spans and writes them in Chrome trace-event JSON,
+ * viewable in chrome://tracing or Perfetto.
+ * Tracing is enabled by setting NEUROPIA_TRACE environment variable or TraceFile parameter to an output file name,
+ * the file is written at exit. Define NEUROPIA_NO_TRACE to compile tracing out.
+ */
+class Trace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief The Span class records its lifetime
+     */
+    class Span {
+    public:
+        explicit Span(const char* name) noexcept : m_name(name), m_start(Trace::instance().isEnabled() ? Clock::now() : Clock::time_point{}) {}
+        ~Span() {
+            if(m_start != Clock::time_point{})
+                Trace::instance().add(m_name, m_start, Clock::now());
+        }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+    private:
+        const char* const m_name;
+        const Clock::time_point m_start;
+    };
+
+    /**
+     * @brief instance
+     * @return
+     */
+    static Trace& instance() {
+        static Trace trace;
+        return trace;
+    }
+
+    /**
+     * @brief start tracing
+     * @param filename where trace is written at exit
+     */
+    void start(const std::string& filename) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_filename = filename;
+        m_enabled = true;
+    }
+
+    /**
+     * @brief isEnabled
+     * @return
+     */
+    bool isEnabled() const {return m_enabled.load(std::memory_order_relaxed);}
+
+    /**
+     * @brief add a span
+     * @param name must be a string literal or otherwise outlive the Trace
+     * @param begin
+     * @param end
+     */
+    void add(const char* name, Clock::time_point begin, Clock::time_point end) {
+        const auto tid = threadId();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_events.push_back({name, begin, end, tid});
+    }
+
+    /**
+     * @brief write events recorded so far
+     * @return false if file cannot be written
+     */
+    bool write() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::ofstream out(m_filename);
+        if(!out) {
+            std::cerr << "Cannot write trace to \"" << m_filename << "\"" << std::endl;
+            return false;
+        }
+        const auto us = [this](Clock::duration d) {
+            return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        };
+        out << "{\"traceEvents\":[\n";
+        for(auto i = 0U; i < m_events.size(); i++) {
+            const auto& e = m_events[i];
+            out << "{\"name\":\"" << e.name << "\",\"cat\":\"neuropia\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+                << ",\"ts\":" << us(e.begin - m_epoch) << ",\"dur\":" << us(e.end - e.begin) << "}"
+                << (i + 1 < m_events.size() ? ",\n" : "\n");
+        }
+        out << "],\"displayTimeUnit\":\"ms\"}\n";
+        return out.good();
+    }
+
+    ~Trace() {
+        if(m_enabled)
+            write();
+    }
+
+    Trace(const Trace&) = delete;
+    Trace& operator=(const Trace&) = delete;
+
+private:
+    Trace() {
+        const auto env = std::getenv("NEUROPIA_TRACE");
+        if(env && *env)
+            start(env);
+    }
+
+    static unsigned threadId() {
+        static std::atomic<unsigned> next{0};
+        thread_local const unsigned id = next++;
+        return id;
+    }
+
+private:
+    struct Event {
+        const char* name;
+        Clock::time_point begin;
+        Clock::time_point end;
+        unsigned tid;
+    };
+    mutable std::mutex m_mutex = {};
+    std::atomic<bool> m_enabled{false};
+    std::string m_filename = {};
+    std::vector<Event> m_events = {};
+    const Clock::time_point m_epoch = Clock::now();
+};
+}
+
+#define NEUROPIA_TRACE_CAT_(a, b) a##b
+#define NEUROPIA_TRACE_CAT(a, b) NEUROPIA_TRACE_CAT_(a, b)
+
+#ifdef NEUROPIA_NO_TRACE
+#define NEUROPIA_TRACE(name)
+#else
+/// @brief Records a span from this point to the end of the scope
+#define NEUROPIA_TRACE(name) const Neuropia::Trace::Span NEUROPIA_TRACE_CAT(neuropia_trace_, __LINE__)(name)
+#endif
+
+#endif // TRACE_H
@@ -3,9 +3,14 @@
 
 #include <iostream>
 #include <vector>
+#include <mutex>
+#include <unordered_map>
 #include "neuropia.h"
 #include "idxreader.h"
 #include "utils.h"
+#include "validator.h"
+#include "profiler.h"
+#include "trace.h"
 
 
 namespace Neuropia {
@@ -14,6 +19,19 @@ namespace Neuropia {
 
 constexpr NeuronType MaxTrainTime = 999999;
 
+/**
+ * @brief Topmost frozen layer activations per sample, shared between training threads
+ */
+class FrozenCache {
+public:
+    /// @brief cached activations, empty if not found
+    ValueVector get(size_t sample) const;
+    void set(size_t sample, const ValueVector& activations);
+private:
+    mutable std::mutex m_mutex = {};
+    std::unordered_map<size_t, ValueVector> m_activations = {};
+};
+
 class TrainerBase {
 public:
     TrainerBase(const std::string& root, const Neuropia::Params& params, bool quiet);
@@ -25,8 +43,43 @@ public:
     /// @brief must be called before train
     /// @return 
     bool init();
+    /// @brief number of samples trained
+    size_t trainedSamples() const {return m_trainedSamples;}
+    /// @brief time when a network reaching TargetAccuracy was taken to validation, if any
+    std::optional<std::chrono::high_resolution_clock::time_point> targetReached() const {return m_targetReached;}
+    /// @brief time and count per training phase, collected if Profile is set
+    Profiler::Stats profile() const {return m_profiler.stats();}
 protected:
     virtual bool doTrain() = 0;
+    /// @brief validates parameters and runs doTrain, phases that follow the training, e.g. factorization, are run by train
+    /// only, hence a trainer that steps training by repeated calls uses this
+    bool trainStep();
+    /// @brief trains network with a sample
+    /// @param learningRateScale multiplies the current learning rate, e.g. per individual
+    bool trainSample(Neuropia::Layer& network, size_t sample, const std::vector<NeuronType>& inputs, const std::vector<NeuronType>& outputs, NeuronType learningRateScale = 1);
+    /// @brief on every TestFrequency iteration validates a snapshot of network in background, the previous result is handled when ready
+    /// @return false if early stopping criteria is met and training shall stop
+    bool testVerify(size_t iteration, const Neuropia::Layer& network);
+    /// @brief waits and handles a pending validation
+    void testVerifyResult();
+    /// @brief to be called when network is trained, restores the best validated snapshot if early stopping is used
+    void trainingEnd();
+    /// @brief prunes the trained network to Prune sparsity, in PruneCycles steps each followed by fine-tuning
+    bool pruneTrain();
+    /// @brief factorizes the first hidden layer of the trained network to Rank and fine-tunes it
+    bool factorizeTrain();
+    /// @brief resets the training state to train the network again, e.g. to fine-tune it
+    /// @param iterations of the new training, zero keeps the current
+    void restart(unsigned iterations);
+    /// @brief progress output is rate limited to ProgressInterval
+    /// @return true if progress shall be printed now
+    bool progress() {return !m_quiet && m_progress();}
+    /// @brief samples are drawn from the beginning of the training data, the rest is held out for validation
+    /// @return number of trained samples
+    size_t trainingSize() const {return m_images.size() - m_heldOut;}
+    /// @brief sets random stream of the calling thread, used in dropout, so that runs of the same Seed are reproducible
+    /// @param job index of the job in the run, zero is the main thread
+    void jobStream(size_t job) const {Philox::thread() = Philox::stream(Philox::Stream::Dropout, m_run, job);}
 protected:
     const std::string m_imageFile;
     const std::string m_labelFile;
@@ -48,9 +101,42 @@ protected:
     const std::vector<int> m_topology;
     const std::vector<Neuropia::ActivationFunction> m_afs;
     const Layer::InitStrategy m_initStrategy;
+    const std::vector<int> m_freeze;
+    const bool m_freezeCache;
+    std::unique_ptr<FrozenCache> m_frozenCache = {};
+    const Optimizer m_optimizer;
+    const bool m_softmax;
     const NeuronType m_maxTrainTime;
     const std::function<void (const std::function<void ()>&, const std::string&)> m_control;
+    uint64_t m_run = 0;
     Neuropia::Random m_random = {};
+    const std::string m_validationImageFile;
+    const std::string m_validationLabelFile;
+    const bool m_holdOut;
+    const unsigned m_validationSize;
+    size_t m_heldOut = 0;
+    std::unique_ptr<Validator> m_validator = {};
+    std::future<Validation> m_validation = {};
+    std::shared_ptr<const Neuropia::Layer> m_snapshot = {};
+    const unsigned m_earlyStopPatience;
+    const NeuronType m_earlyStopDelta;
+    const bool m_earlyStopLoss;
+    const NeuronType m_targetAccuracy;
+    std::shared_ptr<const Neuropia::Layer> m_best = {};
+    NeuronType m_bestScore = 0;
+    unsigned m_noImprovement = 0;
+    bool m_stop = false;
+    size_t m_trainedSamples = 0;
+    std::chrono::high_resolution_clock::time_point m_snapshotTime = {};
+    std::optional<std::chrono::high_resolution_clock::time_point> m_targetReached = std::nullopt;
+    Profiler m_profiler = {};
+    Throttle m_progress;
+    const bool m_arena;
+    const NeuronType m_prune;
+    const unsigned m_pruneCycles;
+    const unsigned m_pruneIterations;
+    const unsigned m_rank;
+    const unsigned m_rankIterations;
 };
 }
 
@@ -47,13 +47,16 @@ void percentage(T1 fraction, T2 total, const std::string& extra = "") {
         std::cout << "\r" << std::fixed << std::setprecision(3) << f << '%' << extra << std::flush;
 }
 
+/**
+ * @brief The Random class draws sample indices from the sampling stream of the run seed, each instance is a run of its own
+ */
 class Random {
 public:
     explicit Random(unsigned seed);
     Random();
     size_t random(size_t atop);
 private:
-    std::default_random_engine m_gen;
+    Philox m_gen;
 };
 
 std::string_view to_string(Neuropia::SaveType st);
@@ -0,0 +1,80 @@
+#ifndef VALIDATOR_H
+#define VALIDATOR_H
+
+#include <future>
+#include <limits>
+#include "neuropia.h"
+
+namespace Neuropia {
+
+/**
+ * @brief Result of a validation round
+ */
+struct Validation {
+    unsigned found = 0;     ///< correctly classified
+    unsigned count = 0;     ///< validated samples
+    NeuronType loss = 0;    ///< mean loss per sample, cross-entropy for a softmax output, else squared error
+    /**
+     * @brief accuracy
+     * @return found / count
+     */
+    NeuronType accuracy() const {return count > 0 ? static_cast<NeuronType>(found) / static_cast<NeuronType>(count) : 0;}
+};
+
+/**
+ * @brief The Validator class keeps a normalized validation set in memory, so a network
+ * can be checked repeatedly during the training without reopening and decoding the files.
+ */
+class Validator {
+public:
+    /**
+     * @brief Validator
+     * @param imageFile
+     * @param labelFile
+     * @param count maximum number of samples loaded
+     * @param first sample loaded, e.g. the beginning of a slice held out from training
+     */
+    Validator(const std::string& imageFile, const std::string& labelFile, size_t count = std::numeric_limits<size_t>::max(), size_t first = 0);
+
+    /**
+     * @brief ok
+     * @return data was loaded
+     */
+    bool ok() const {return !m_labels.empty();}
+
+    /**
+     * @brief size
+     * @return number of samples
+     */
+    size_t size() const {return m_labels.size();}
+
+    /**
+     * @brief validate, network is fed as is and is therefore expected to be in inference state
+     * @param network
+     * @return
+     */
+    Validation validate(const Layer& network) const;
+
+    /**
+     * @brief validateAsync takes an inference copy of network and validates it in a background thread, thus the network
+     * can be trained meanwhile. The validator has to stay alive until the result is got.
+     * @param network
+     * @return
+     */
+    std::future<Validation> validateAsync(const Layer& network) const;
+
+    /**
+     * @brief validateAsync validates network as is in a background thread, the network is kept alive until the result is got.
+     * @param network
+     * @return
+     */
+    std::future<Validation> validateAsync(const std::shared_ptr<const Layer>& network) const;
+
+private:
+    size_t m_inputSize = 0;
+    std::vector<unsigned char> m_inputs = {}; // raw, normalized in feed
+    std::vector<unsigned> m_labels = {};
+};
+}
+
+#endif // VALIDATOR_H
@@ -2,11 +2,32 @@
 #define VERIFY_H
 
 #include <algorithm>
+#include <limits>
 #include "neuropia.h"
 #include "idxreader.h"
 #include "utils.h"
 
 namespace Neuropia {
+
+/// @brief Activation statistics of a neuron
+struct NeuronStats {
+    /// @brief mean activation
+    NeuronType mean;
+    /// @brief standard deviation of activation
+    NeuronType deviation;
+};
+
+/**
+ * @brief activationStats, feeds images through the network and collects the activations of its neurons
+ * @param network
+ * @param imageFile
+ * @param count maximum number of images fed
+ * @return statistics per neuron of each layer after the input layer, empty if images cannot be read
+ */
+std::vector<std::vector<NeuronStats>> activationStats(const Neuropia::Layer& network,
+                 const std::string& imageFile,
+                 size_t count = std::numeric_limits<unsigned>::max());
+
 /**
  * @brief verify
  * @param network
@@ -3,7 +3,9 @@
 #include <vector>
 #include <string>
 #include <optional>
+#include <memory>
 #include "neuropia.h"
+#include "threadpool.h"
 
 /**
  * @brief Interface to use network
@@ -49,7 +51,32 @@ namespace Neuropia
              */
 
             template <typename IT>
-            const Values& feed(IT begin, IT end) const {return m_network.feed(begin, end);}
+            const Values& feed(IT begin, IT end) const {
+                return m_pool ? m_network.feed(begin, end, *m_pool, m_minWork) : m_network.feed(begin, end);
+            }
+
+            /**
+             * @brief Feed raw values, e.g. image bytes, normalization is done within the first layer.
+             * 
+             * @param scale input is normalized as value * scale + offset
+             * @param offset 
+             * @return Values 
+             */
+            template <typename IT>
+            const Values& feed(IT begin, IT end, NeuronType scale, NeuronType offset = 0) const {
+                return m_pool ? m_network.feed(begin, end, scale, offset, *m_pool, m_minWork) : m_network.feed(begin, end, scale, offset);
+            }
+
+            /**
+             * @brief Feed a large layer with many threads, for a low latency of a single input. Off by default.
+             * 
+             * @param threads number of threads including the calling one, 0 is as many as the hardware has, 1 is off
+             * @param minWork minimum number of weights fed by a thread, a smaller layer is fed by the calling thread
+             */
+            void setThreads(unsigned threads, size_t minWork = Layer::ParallelFeedWork) {
+                m_pool = threads != 1 ? std::make_unique<ThreadPool>(threads) : nullptr;
+                m_minWork = minWork;
+            }
 
             /**
              * @brief Access to Neuropia network input layer
@@ -59,5 +86,7 @@ namespace Neuropia
             const Layer& network() const {return m_network;}
         private:
             Layer m_network = {};
+            std::unique_ptr<ThreadPool> m_pool = nullptr;
+            size_t m_minWork = Layer::ParallelFeedWork;
    };
 } // namespace Neuropia
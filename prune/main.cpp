@@ -0,0 +1,95 @@
+#include "argparse.h"
+#include "utils.h"
+#include "verify.h"
+#include <cmath>
+#include <numeric>
+#include <iostream>
+#include <filesystem>
+
+
+int main(int argc, char* argv[]) {
+
+    ArgParse argparse;
+    argparse.addOpt('d', "data_type", true, "double");
+    argparse.addOpt('n', "neurons", true);
+
+    if(!argparse.set(argc, argv)) {
+        std::cerr << "Invalid args" << std::endl;
+        return -1;
+    }
+
+    if(argparse.paramCount() < 4) {
+        std::cerr << "neuropia_prune <--data_type <double|float|longDouble>> <--neurons IMAGES> NETWORK_FILE OUTPUT SPARSITY" << std::endl;
+        std::cerr << "Zeroes the smallest magnitude weights of each layer so that SPARSITY fraction (0 - 1) of them are zero." << std::endl;
+        std::cerr << "Pruned layers are stored as compressed sparse rows when that is smaller. To fine-tune after pruning, train with Prune parameter instead." << std::endl;
+        std::cerr << "With --neurons, SPARSITY fraction of neurons of each hidden layer are removed instead, the least varying on IMAGES first," << std::endl;
+        std::cerr << "and the layers shrink so that the network stays dense." << std::endl;
+        return 1;
+    }
+
+    Neuropia::SaveType save_type = Neuropia::SaveType::SameAsNeuronType;
+
+    if(argparse.hasOption("data_type")) {
+        if(argparse.option("data_type") == "double")
+            save_type = Neuropia::SaveType::Double;
+        else if(argparse.option("data_type") == "float")
+            save_type = Neuropia::SaveType::Float;
+        else if(argparse.option("data_type") == "longDouble")
+            save_type = Neuropia::SaveType::LongDouble;
+        else {
+            std::cerr << "Bad data type --data_type <double|float|longDouble>" << std::endl;
+            return 1;
+        }
+    }
+
+    const auto sparsity = std::atof(argparse.param(3).c_str());
+    if(sparsity < 0.0 || sparsity >= 1.0) {
+        std::cerr << "Bad SPARSITY, expected 0 <= SPARSITY < 1" << std::endl;
+        return 1;
+    }
+
+    auto loaded = Neuropia::load(argparse.param(1));
+    if(!loaded) {
+        return 2;
+    }
+    auto& [network, meta] = *loaded;
+
+    if(argparse.hasOption("neurons")) {
+        const auto stats = Neuropia::activationStats(network, argparse.option("neurons"));
+        if(stats.empty()) {
+            return 2;
+        }
+        // a neuron that hardly varies or has small outgoing weights contributes least, its mean is folded to the next biases
+        for(auto i = 1; network.get(i)->next() != nullptr; i++) {
+            auto layer = network.get(i);
+            const auto& layerStats = stats[static_cast<size_t>(i - 1)];
+            Neuropia::ValueVector scores(layer->size(), 0);
+            for(const auto& n : *layer->next()) {
+                for(auto j = 0U; j < n.size(); j++)
+                    scores[j] += n.weight(j) * n.weight(j);
+            }
+            Neuropia::ValueVector means(layer->size());
+            for(auto j = 0U; j < layer->size(); j++) {
+                scores[j] = layerStats[j].deviation * std::sqrt(scores[j]);
+                means[j] = layerStats[j].mean;
+            }
+            const auto count = std::min(static_cast<size_t>(sparsity * static_cast<double>(layer->size())), layer->size() - 1);
+            std::vector<unsigned> indices(layer->size());
+            std::iota(indices.begin(), indices.end(), 0U);
+            std::partial_sort(indices.begin(), indices.begin() + static_cast<std::ptrdiff_t>(count), indices.end(), [&scores](auto a, auto b) {
+                return scores[a] < scores[b];
+            });
+            indices.resize(count);
+            layer->removeNeurons(indices, means);
+        }
+    } else {
+        network.prune(static_cast<Neuropia::NeuronType>(sparsity));
+    }
+    Neuropia::save(argparse.param(2), network, meta, save_type);
+
+    for(auto i = 1; network.get(i) != nullptr; i++) {
+        std::cout << "L:" << i << " size:" << network.get(i)->size() << " sparsity:" << network.get(i)->sparsity() << std::endl;
+    }
+    std::cout << "bytes: " << std::filesystem::file_size(argparse.param(1)) << " -> " << std::filesystem::file_size(argparse.param(2)) << std::endl;
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include "evotrain.h"
 #include "params.h"
+#include "threadpool.h"
 
 using namespace Neuropia;
 
@@ -7,105 +8,157 @@ TrainerEvo::TrainerEvo(const std::string& root, const Neuropia::Params& params,
     : TrainerBase(root, params, quiet),
       m_jobs(params.uinteger("Jobs")),
       m_batchSize(params.uinteger("BatchSize")),
-      m_batchVerifySize(params.uinteger("BatchVerifySize")){
+      m_batchVerifySize(params.uinteger("BatchVerifySize")),
+      m_population(params.uinteger("Population") > 0 ? std::max(params.uinteger("Population"), 2U)
+                                                      : std::max(m_jobs, 1U) + std::max(params.uinteger("Elite"), 1U)),
+      m_elite(std::clamp(params.uinteger("Elite"), 1U, m_population - 1)),
+      m_learningRateSpread(params.real("LearningRateSpread")) {
 }
 
 bool TrainerEvo::doTrain() {
-    //copy network for jobs
-    std::vector<Neuropia::Layer> offsprings(m_jobs);
-    std::fill(offsprings.begin(), offsprings.end(), this->m_network);
-
-    std::vector<std::thread> threads(m_jobs);
-    std::vector<int> results(m_jobs);
+    // individuals are trained and then ranked by fitness, the elite survives as parents of the next generation,
+    // the first m_elite individuals are the parents, they are not trained but ranked again with their offspring
+    std::vector<Neuropia::Layer> individuals(m_population, this->m_network);
+    std::vector<NeuronType> rates(m_population, 1);  // learning rate scale per individual
+    std::vector<unsigned> crossovers(m_population, 0);  // 1 + index of the parent merged in, zero if none
+    std::vector<Neuropia::Layer> parents;
+    std::vector<NeuronType> parentRates;
+
+    ThreadPool pool(m_jobs);
+    std::vector<int> results(m_population);
+    std::vector<unsigned> ranking(m_population);
     const auto inputSize = m_images.size(1) * m_images.size(2);
-    std::vector<std::vector<std::tuple<std::vector<unsigned char>, unsigned char>>> batches(m_jobs);
-    std::vector<std::vector<std::tuple<std::vector<unsigned char>, unsigned char>>> batchesVerify(m_jobs);
-
-    auto maxNet = 0U;
+    std::vector<std::vector<std::tuple<std::vector<unsigned char>, unsigned char, size_t>>> batches(m_population);
+    // fitness of all individuals is evaluated on the same samples, they are normalized once
+    std::vector<std::vector<Neuropia::NeuronType>> fitnessInputs(m_batchVerifySize, std::vector<Neuropia::NeuronType>(inputSize));
+    std::vector<unsigned char> fitnessLabels(m_batchVerifySize);
 
     int progressCount = 0;
     const auto load = m_iterations;
 
     Neuropia::timed([&]() {
         Neuropia::iterator(m_iterations, [&](size_t it)  {
+            NEUROPIA_TRACE("iteration");
             ++progressCount;
-            for(auto job = 0U; job < m_jobs; ++job)  {
-
-                auto& batchData = batches[job];
-                batchData.resize(m_batchSize);
-
-                for(auto i = 0U; i < m_batchSize; i++)  {
-                    const auto at = m_random.random(m_images.size());
-                    batchData[i] = {m_images.readAt(at, inputSize), m_labels.readAt(at)};
+            std::vector<size_t> verifyAt(m_batchVerifySize);
+            NEUROPIA_TRACE("batch");
+            {
+                const auto scope = m_profiler.scope(Profiler::Phase::Sampling);
+                // parents are not trained, their batches are empty
+                for(auto b = m_elite; b < m_population; b++) {
+                    auto& batchData = batches[b];
+                    batchData.resize(m_batchSize);
+                    for(auto& batch : batchData)  {
+                        std::get<2>(batch) = m_random.random(trainingSize());
+                    }
+                }
+                for(auto& at : verifyAt)  {
+                    at = m_random.random(trainingSize());
+                }
+            }
+            {
+                const auto scope = m_profiler.scope(Profiler::Phase::Io);
+                for(auto& batchData : batches) {
+                    for(auto& [image, label, at] : batchData)  {
+                        image = m_images.readAt(at, inputSize);
+                        label = m_labels.readAt(at);
+                    }
                 }
-
-                auto& batchVerifyData = batchesVerify[job];
-                batchVerifyData.resize(m_batchVerifySize);
-
                 for(auto i = 0U; i < m_batchVerifySize; i++)  {
-                    const auto at = m_random.random(m_images.size());
-                batchVerifyData[i] = {m_images.readAt(at, inputSize), m_labels.readAt(at)};
+                    const auto image = m_images.readAt(verifyAt[i], inputSize);
+                    std::transform(image.begin(), image.end(), fitnessInputs[i].begin(), [](unsigned char c) {
+                        return Neuropia::normalize(static_cast<Neuropia::NeuronType>(c), 0, 255);
+                    });
+                    fitnessLabels[i] = m_labels.readAt(verifyAt[i]);
                 }
+            }
 
-                // start thread
-                threads[job] = std::thread([&](unsigned currentJob) {
-
-                    //first we train
+            // individuals are scheduled over the pool, parents are not modified meanwhile
+            pool.run(m_population, [&](size_t begin, size_t end) {
+                for(auto current = begin; current < end; current++) {
+                    NEUROPIA_TRACE("job");
+                    jobStream(1 + it * m_population + current);
+                    auto& individual = individuals[current];
+                    if(crossovers[current] > 0) {
+                        const auto scope = m_profiler.scope(Profiler::Phase::Merge);
+                        individual.merge(parents[crossovers[current] - 1], 0.5);
+                    }
 
-                    for(auto i = 0U; i < m_batchSize; i++) {
+                    //first we train offspring
+                    const auto& batchData = batches[current];
+                    for(auto i = 0U; i < batchData.size(); i++) {
                         std::vector<Neuropia::NeuronType> inputData(inputSize);
                         const auto& batch = batchData[i];
-                        std::transform(std::get<0>(batch).begin(), std::get<0>(batch).end(), inputData.begin(), [](unsigned char c) {
-                            return Neuropia::normalize(static_cast<Neuropia::NeuronType>(c), 0, 255);
-                        });
-
                         std::vector<Neuropia::NeuronType> outputs(m_network.outLayer()->size());
-                        const auto index = batchData[i];
-                        outputs[std::get<1>(index)] = 1.0;
+                        {
+                            const auto scope = m_profiler.scope(Profiler::Phase::Normalization);
+                            std::transform(std::get<0>(batch).begin(), std::get<0>(batch).end(), inputData.begin(), [](unsigned char c) {
+                                return Neuropia::normalize(static_cast<Neuropia::NeuronType>(c), 0, 255);
+                            });
+                            outputs[std::get<1>(batch)] = 1.0;
+                        }
 
-                        offsprings[currentJob].train(inputData.begin(), outputs.begin(), m_learningRate, m_lambdaL2);
+                        trainSample(individual, std::get<2>(batch), inputData, outputs, rates[current]);
                     }
-                    //then we verify,
-                    //it may be debatable to use potentially overlaprogressCounting data for verify batches, but
-                    // I assume when samples is small vs. data - and its is on temporary it shall not hard, I definetely wanna
-                    // have any risk to contaminate verification data
+                    //then we verify
+                    NEUROPIA_TRACE("job verify");
+                    const auto scope = m_profiler.scope(Profiler::Phase::Verify);
                     int found = 0;
-                    std::vector<Neuropia::NeuronType> inputs(inputSize);
                     for(auto i = 0U; i < m_batchVerifySize; i++) {
-
-                        std::transform(std::get<0>(batchVerifyData[i]).begin(), std::get<0>(batchVerifyData[i]).end(), inputs.begin(), [](unsigned char c) {
-                            return Neuropia::normalize(static_cast<Neuropia::NeuronType>(c), 0, 255);
-                        });
-                        const auto outputs = offsprings[currentJob].feed(inputs.begin(), inputs.end());
+                        const auto& outputs = individual.feed(fitnessInputs[i].begin(), fitnessInputs[i].end());
                         const auto max = static_cast<size_t>(std::distance(outputs.begin(),
                                                              std::max_element(outputs.begin(), outputs.end())));
-                        if(max == std::get<1>(batchVerifyData[i])) {
+                        if(max == fitnessLabels[i]) {
                             ++found;
                         }
                     }
-                    results[currentJob] = found;
-                }, job);
-
-                // end thread
-            }
-
-            for(auto& thread : threads) {// wait em all
-                thread.join();
-            }
-
-            //then find best network
-            int maxmax = 0;
-            for(auto index = 0U;  index < m_jobs ; index++) {
-                if(results[index] > maxmax) {
-                    maxmax = results[index];
-                    maxNet = index;
+                    results[current] = found;
+                }
+            });
+            m_trainedSamples += (m_population - m_elite) * m_batchSize;
+
+            //then rank networks, an offspring is preferred to its equal parent, else the training would not
+            //proceed until an offspring is strictly better
+            std::iota(ranking.begin(), ranking.end(), 0U);
+            std::rotate(ranking.begin(), ranking.begin() + m_elite, ranking.end());
+            std::stable_sort(ranking.begin(), ranking.end(), [&results](auto a, auto b) {return results[a] > results[b];});
+            const auto maxmax = results[ranking.front()];
+
+            //the elite are parents of the next generation as they are, others are their copies or crossovers with a learning rate perturbed
+            {
+                NEUROPIA_TRACE("offsprings");
+                const auto scope = m_profiler.scope(Profiler::Phase::Merge);
+                parents.resize(m_elite);
+                parentRates.resize(m_elite);
+                for(auto e = 0U; e < m_elite; e++) {
+                    parents[e] = individuals[ranking[e]];
+                    parentRates[e] = rates[ranking[e]];
                 }
+                for(auto i = 0U; i < m_population; i++) {
+                    const auto parent = i % m_elite;
+                    individuals[i] = parents[parent];
+                    rates[i] = parentRates[parent];
+                    crossovers[i] = 0;
+                    if(i < m_elite) {
+                        continue;
+                    }
+                    if(m_elite > 1) {
+                        crossovers[i] = 1 + static_cast<unsigned>((parent + 1 + m_random.random(m_elite - 1)) % m_elite);
+                    }
+                    if(m_learningRateSpread > 0) {
+                        // spread in log scale around the current learning rate, not inherited, as a short training
+                        // favors smaller rates and inherited rates would drift down generation by generation
+                        const auto u = static_cast<NeuronType>(m_random.random(2001)) / 1000 - 1;
+                        rates[i] = std::exp(m_learningRateSpread * u);
+                    }
+                }
+            }
+            if(!testVerify(it, parents.front())) {
+                return false;
             }
-            //copy best of network for jobs
-            std::fill(offsprings.begin(), offsprings.end(), offsprings[maxNet]);
 
             if(m_maxTrainTime >= MaxTrainTime) {
-                if(!m_quiet)
+                if(progress())
                     std::cout << "\r" << it << " " << maxmax << " " << results << " "
                               << std::setprecision(3) << (100.0 * (static_cast<NeuronType>(progressCount) / static_cast<NeuronType>(load))) << '%' << std::flush;
                 m_learningRate += (1.0 / static_cast<NeuronType>(m_iterations)) * (m_learningRateMin - m_learningRateMax);
@@ -120,16 +173,19 @@ bool TrainerEvo::doTrain() {
                 this->m_gap = delta;
                 this->m_learningRate += (static_cast<NeuronType>(change) / static_cast<NeuronType>(this->m_maxTrainTime)) * (this->m_learningRateMin - this->m_learningRateMax);
 
-                if(!this->m_quiet)
+                if(progress())
                     std::cout << "\r" << it << " " << maxmax << " " << results << " "
                               << std::setprecision(3) << (100.0 * (delta / static_cast<NeuronType>(this->m_maxTrainTime))) << '%' << std::flush;
 
             }
             return true;
         });
-        this->m_network = std::move(offsprings[maxNet]); // then we have done...
+        if(!parents.empty()) {
+            this->m_network = std::move(parents.front()); // then we have done...
+        }
         std::cout << std::endl;
     }, "Training evolutionally");
     this->m_network.inverseDropout();
+    trainingEnd();
     return true;
     }
@@ -1,5 +1,7 @@
 #include "neuropia.h"
 #include "matrix.h"
+#include "trace.h"
+#include "threadpool.h"
 #include <string_view>
 #include <random>
 #include <iostream>
@@ -58,7 +60,6 @@ std::function<void (std::ofstream& stream, NeuronType n)> write_fn(SaveType save
     }
 }
 
-/*
 static
 auto data_sz(SaveType saveType) {
     auto neuron_sz = sizeof(NeuronType);
@@ -80,7 +81,6 @@ auto data_sz(SaveType saveType) {
     }
     return neuron_sz; 
 }
-*/
 
 class Neuropia::StreamBase  {
 private:
@@ -146,7 +146,7 @@ public:
 class ByteStream : public StreamBase {
 public:
     ByteStream(const std::vector<uint8_t>& vec) : m_vec(vec) {}
-    bool eof() const {return m_pos >= m_vec.size();}
+    bool eof() const {return m_eof;} // as std::ifstream, set when read past the end
 protected:
     size_t read_to(char* target, size_t size) {
         auto sz = std::min(m_vec.size() - m_pos, size);
@@ -154,11 +154,13 @@ protected:
             std::memcpy(target, &m_vec[m_pos], sz);
             m_pos += sz;
         }
+        m_eof = m_eof || sz < size;
         return sz;
     }    
 private:
     const std::vector<uint8_t>& m_vec;
     size_t m_pos = 0;
+    bool m_eof = false;
 };
 
 class IfStream : public StreamBase {
@@ -180,7 +182,7 @@ private:
 class BytePtrStream : public StreamBase {
 public:
     BytePtrStream(const uint8_t* bytes, size_t sz) : m_bytes(bytes), m_sz(sz) {}
-    bool eof() const {return m_pos >= m_sz;}
+    bool eof() const {return m_eof;} // as std::ifstream, set when read past the end
     BytePtrStream(const BytePtrStream&) = delete;
     BytePtrStream& operator=(const BytePtrStream&) = delete;
 protected:
@@ -190,12 +192,14 @@ protected:
         std::memcpy(target, &m_bytes[m_pos], sz);
         m_pos += sz;
     }
+    m_eof = m_eof || sz < size;
     return sz;
 }
 private:
     const uint8_t* m_bytes;
     const size_t m_sz;
     size_t m_pos = 0;
+    bool m_eof = false;
 };
 
 
@@ -259,6 +263,7 @@ DerivativeFunction Neuropia::derivativeMap(ActivationFunction af) {
     if(sigmoidFunction == af) return sigmoidFunctionDerivative;
     if(reLuFunction == af) return reLuFunctionDerivative;
     if(eluFunction == af) return eluFunctionDerivative;
+    if(linearFunction == af) return linearFunctionDerivative;
     return nullptr;
 }
 
@@ -339,8 +344,7 @@ Layer::Layer(const std::initializer_list<Neuron>& list, const ActivationFunction
 }
 
 Layer::Layer(size_t count, const ActivationFunction& activationFunction, const Neuron& proto) noexcept : m_activationFunction(activationFunction) {
-    m_neurons.resize(static_cast<unsigned>(count));
-    std::fill(m_neurons.begin(), m_neurons.end(), proto);
+    m_neurons.write().assign(count, proto);
     m_outBuffer.resize(m_neurons.size());
 }
 
@@ -348,7 +352,14 @@ Layer::Layer(Layer&& other) noexcept :
     m_neurons(std::move(other.m_neurons)),
     m_next(std::move(other.m_next)),
     m_activationFunction(other.m_activationFunction),
-    m_outBuffer(m_neurons.size()){
+    m_frozen(other.m_frozen),
+    m_optimizer(other.m_optimizer),
+    m_optimizerState(std::move(other.m_optimizerState)),
+    m_outBuffer(m_neurons.size()),
+    m_dropped(std::move(other.m_dropped)),
+    m_active(std::move(other.m_active)),
+    m_pruned(other.m_pruned),
+    m_csr(std::move(other.m_csr)) {
     if(m_next) {
         m_next->m_prev = this;
     }
@@ -356,11 +367,22 @@ Layer::Layer(Layer&& other) noexcept :
 
 Layer::Layer(const Layer& other) noexcept:
     m_neurons(other.m_neurons),
-    m_next(other.m_next != nullptr ? new Layer(*other.m_next) : nullptr),
     m_activationFunction(other.m_activationFunction),
-    m_outBuffer(m_neurons.size()) {
-    if(m_next) {
-        m_next->m_prev = this;
+    m_frozen(other.m_frozen),
+    m_optimizer(other.m_optimizer),
+    m_optimizerState(other.m_optimizerState),
+    m_outBuffer(m_neurons.size()),
+    m_dropped(other.m_dropped),
+    m_active(other.m_active),
+    m_pruned(other.m_pruned),
+    m_csr(other.m_csr) {
+    // following layers are copied iteratively, a long chain does not recurse
+    auto layer = this;
+    for(auto source = other.m_next.get(); source != nullptr; source = source->m_next.get()) {
+        layer->m_next = std::make_unique<Layer>();
+        layer->m_next->assignLayer(*source);
+        layer->m_next->m_prev = layer;
+        layer = layer->m_next.get();
     }
 }
 
@@ -369,17 +391,15 @@ Layer& Layer::join(size_t count, const Neuron& proto) {
 }
 
 Layer& Layer::join(Layer* next) {
-    if(m_next) {
-        return m_next->join(next);
-    }
-    m_next.reset(next);
-    const ValueVector w(m_neurons.size());
-    for(auto& n : next->m_neurons) {
+    const auto last = outLayer();
+    last->m_next.reset(next);
+    const ValueVector w(last->m_neurons.size());
+    for(auto& n : next->m_neurons.write()) {
         if(!n.hasWeights()) {
             n.setWeights(w);
         }
     }
-    next->m_prev = this;
+    next->m_prev = last;
     return *next;
 }
 
@@ -388,59 +408,60 @@ Layer& Layer::join(const std::initializer_list<int>& topology, const Neuron& pro
 }
 
 void Layer::append(const Neuron& neuron) {
-    m_neurons.push_back(neuron);
+    m_neurons.write().push_back(neuron);
     m_outBuffer.resize(m_neurons.size());
 }
 
 void Layer::fill(size_t count, const Neuron& proto) {
-    m_neurons.resize(count);
-    std::fill(m_neurons.begin(), m_neurons.end(), proto);
+    m_neurons.write().assign(count, proto);
     m_outBuffer.resize(m_neurons.size());
 }
 
 void Layer::randomize(NeuronType min, NeuronType max) {
-    if(!isInput()) {  //actually not needed as setweights wont do notting for input layers
-        const auto seed =
-#ifndef RANDOM_SEED
-                static_cast<unsigned>(std::chrono::system_clock::now().time_since_epoch().count())
-#else
-        RANDOM_SEED
-#endif
-        ;
-        std::default_random_engine gen(seed);
-        std::uniform_real_distribution<> dis(min, max);
-
-        for(auto& n : m_neurons) {
-            for(size_t i = 0; i < n.size(); i++) {
-                n.setWeight(i, static_cast<NeuronType>(dis(gen)));
+    const auto run = Philox::run();
+    auto layerDepth = depth();
+    for(auto layer = this; layer != nullptr; layer = layer->m_next.get(), ++layerDepth) {
+        layer->m_pruned = false;
+        layer->m_csr = {};
+        if(!layer->isInput()) {  //actually not needed as setweights wont do notting for input layers
+            auto gen = Philox::stream(Philox::Stream::Initialize, run, layerDepth);
+            std::uniform_real_distribution<> dis(min, max);
+
+            for(auto& n : layer->m_neurons.write()) {
+                for(size_t i = 0; i < n.size(); i++) {
+                    n.setWeight(i, static_cast<NeuronType>(dis(gen)));
+                }
+            }
+            for(auto& n : layer->m_neurons.write()) { //for certain testability reasons we have second loop to set biases
+                n.setBias(static_cast<NeuronType>(dis(gen)));
+            }
+        } else {
+            for(auto& n : layer->m_neurons.write()) {
+                n.setBias(0);
             }
         }
-        for(auto& n : m_neurons) { //for certain testability reasons we have second loop to set biases
-            n.setBias(static_cast<NeuronType>(dis(gen)));
-        }
-    } else {
-        for(auto& n : m_neurons) {
-            n.setBias(0);
-        }
-    }
-    if(m_next) {
-        m_next->randomize(min, max);
     }
 }
 
 
 Layer* Layer::outLayer() {
-    if(m_next == nullptr) {
-        return this;
+    auto layer = this;
+    while(layer->m_next != nullptr) {
+        layer = layer->m_next.get();
     }
-    return m_next->outLayer();
+    return layer;
 }
 
 const Layer* Layer::outLayer() const {
-    if(m_next == nullptr) {
-        return this;
+    return const_cast<Layer*>(this)->outLayer();
+}
+
+size_t Layer::depth() const {
+    size_t d = 0;
+    for(auto layer = m_prev; layer != nullptr; layer = layer->m_prev) {
+        ++d;
     }
-    return m_next->outLayer();
+    return d;
 }
 
 Layer* Layer::previousLayer(Layer* current) {
@@ -456,15 +477,7 @@ const Layer* Layer::previousLayer(const Layer* current) const {
  //see://www.youtube.com/watch?v=QJoa0JYaX1I - there are several episode
  //video how that works, therefore only the most basic comments are injected here that may
  //help you the implementation vs. explanation on video
-bool Layer::backpropagation(const ValueVector& outValues, const ValueVector& expectedValues, NeuronType learningRate, NeuronType lambdaL2, const DerivativeFunction& df) {
-
-//expected values as Matrix
-    const auto expected = Matrix<NeuronType>::fromArray(expectedValues, Matrix<NeuronType>::VecDir::row);
-
-//get results as matrices
-    auto lastValues = Matrix<NeuronType>::fromArray(outValues, Matrix<NeuronType>::VecDir::row);
-//get error if actual output is too big, error is negative
-    auto errors = expected - lastValues;
+bool Layer::backpropagation(const ValueVector& outValues, const TempVector& expectedValues, NeuronType learningRate, NeuronType lambdaL2, const DerivativeFunction& df) {
 
 //we go backwards
     auto lastLayer = outLayer();
@@ -473,100 +486,155 @@ bool Layer::backpropagation(const ValueVector& outValues, const ValueVector& exp
         return false;    //sanity
     }
 
-//get layer as Matrix
-    auto layerData = Matrix<NeuronType>::fromArray(previousLayer(lastLayer)->m_outBuffer, Matrix<NeuronType>::VecDir::row);
+    if(lastLayer->m_frozen) {
+        return true;    //nothing to train
+    }
 
+//get error if actual output is too big, error is negative
+    TempVector errors(outValues.size());
+    for(auto i = 0U; i < errors.size(); i++) {
+        errors[i] = expectedValues[i] - outValues[i];
+    }
+
+    const ValueVector* lastValues = &outValues;
+    TempVector gradients;
+    TempVector deltas;
+    TempVector prevErrors;
+
+    // Weights and errors of dropped neurons are left out, i.e. only rows of active neurons and columns
+    // of active inputs are computed. As outputs of dropped neurons are zero the results are equal to
+    // the full matrices masked.
     for(;;) {
+        const auto prevLayer = previousLayer(lastLayer);
+        // errors are not needed below the input nor the topmost frozen layer
+        const auto isLast = prevLayer->isInput() || prevLayer->m_frozen;
+        const auto rows = lastLayer->size();
+        const auto cols = prevLayer->size();
+        const auto& layerData = prevLayer->m_outBuffer;
+        neuropia_assert(lastLayer->m_active.size() <= rows && prevLayer->m_active.size() <= cols);
 
         // y is already a sigmoid value  - the function is derivated  sigmoidfunction
         // if s(x) =  1 / (1 + e^-x) then s`(x) = s(x)(1 - s(x)), but since given y is already s(x)
         // the derivated value can be written as
-        const auto gradientDelta = lastValues.map(df);
         //not that * operands here are elemental multipcations, not matrix muls
-        auto gradients = learningRate * errors * gradientDelta;
+        //for softmax with cross-entropy loss the gradient is the error (y - p) as is, no derivative is needed
+        gradients.assign(rows, 0);
+        if(lastLayer->m_activationFunction == softmaxFunction || lastLayer->m_activationFunction == linearFunction) {
+            for(const auto i : lastLayer->m_active)
+                gradients[i] = errors[i];
+        } else {
+            for(const auto i : lastLayer->m_active)
+                gradients[i] = errors[i] * df((*lastValues)[i]);
+        }
 
 #ifdef NEUROPIA_DEBUG
-        if(gradients.reduce<bool>(false, [](bool a, auto r){return a || std::isnan(r) || std::isinf(r);}))
+        if(std::any_of(gradients.begin(), gradients.end(), [](auto r){return std::isnan(r) || std::isinf(r);}))
             return false;
 #endif
 
-        if(!gradients.isValid())
+        if(std::isinf(gradients[0]) || std::isnan(gradients[0]))
             return false;
 
-        //set lastlayer bias, if neuron would be matrix this would be just B += G
-        neuropia_assert(gradients.cols() == 1 && lastLayer->m_neurons.size() == gradients.rows());
-        for(auto i = 0U; i < gradients.rows(); i++) {
-            auto& n = lastLayer->m_neurons[i];
-            if(n.isActive()) { //only if the weight is connected from an active neuron
-                const auto g = gradients(0, i);
-                n.setBias(n.bias() + g);
-            }
-        }
+        // optimizer state has weights first and then biases
+        const auto& optimizer = lastLayer->m_optimizer;
+        auto& state = lastLayer->m_optimizerState;
+        const auto weightCount = rows * cols;
+        state.prepare(weightCount + rows, optimizer.stateCount());
 
+        // a layer shared with copies is copied here, before it is modified
+        auto& neurons = lastLayer->m_neurons.write();
 
-        const auto layerDataTransposed = layerData.transpose();
-
-        if(lambdaL2 > 0.0) {
-            
-            const auto L2 = gradients.reduce<NeuronType>(0, [](auto a, auto r) noexcept {
-                return a + (r * r);
-                }) / static_cast<NeuronType>(gradients.rows());
-            
-            const auto l = lambdaL2 * L2;
-            
-            gradients.mapThis([l](auto v) noexcept {
-                return v - l;
-                });
+        //set lastlayer bias, if neuron would be matrix this would be just B += G
+        deltas.assign(gradients.begin(), gradients.end());
+        optimizer.update(deltas.data(), state.first(weightCount), state.second(weightCount), rows, learningRate, state.step());
+        for(const auto i : lastLayer->m_active) {
+            auto& n = neurons[i];
+            n.setBias(n.bias() + deltas[i]);
         }
 
-        const auto layerDeltas = Matrix<NeuronType>::multiply(gradients, layerDataTransposed);
-
-        const auto prevLayer = previousLayer(lastLayer);
-        auto weightsData =
-            Matrix<NeuronType>::fromArray(lastLayer->m_neurons,
-                                          prevLayer->size(), //fully connected, amount of weights is prev layer neurons
-        
-            [prevLayer](const Neuron & n, Matrix<NeuronType>::index_type index) noexcept {
-                return n.isActive() && (*prevLayer)[index].isActive() ? n.weight(index) : 0.0;
-            });
+        if(lambdaL2 > 0.0) {
 
+            const auto L2 = std::accumulate(gradients.begin(), gradients.end(), static_cast<NeuronType>(0), [](auto a, auto r) noexcept {
+                return a + (r * r);
+                }) / static_cast<NeuronType>(rows);
 
+            const auto l = lambdaL2 * learningRate * L2; // as gradients are not yet scaled with the learning rate
 
-        const auto weightsDataTransposed = weightsData.transpose();
-        const auto weights = weightsData + layerDeltas;
+            for(const auto i : lastLayer->m_active) // dropped neurons get no gradient
+                gradients[i] -= l;
+        }
 
-        // just copy matrix back to network
-        neuropia_assert(weights.rows() == lastLayer->size() && lastLayer->size()  > 0 && lastLayer->m_neurons[0].size() == weights.cols());
+        // weight deltas are the outer product of gradients and the previous layer values, zero for the dropped neurons
+        // and for the zero values, hence for sparse values only their columns are computed
+        const auto sparse = lastLayer->sparseInputs(layerData.begin(), layerData.begin() + static_cast<long>(cols));
+        deltas.resize(weightCount);
+        for(auto i = 0U; i < rows; i++) {
+            const auto g = gradients[i];
+            const auto row = deltas.begin() + static_cast<long>(i * cols);
+            if(lastLayer->isDropped(i) || sparse) {
+                std::fill(row, row + static_cast<long>(cols), 0);
+            }
+            if(lastLayer->isDropped(i)) {
+                continue;
+            }
+            if(sparse) {
+                for(const auto j : lastLayer->m_nonZero)
+                    row[j] = g * layerData[j];
+            } else {
+                for(auto j = 0U; j < cols; j++)
+                    row[j] = g * layerData[j];
+            }
+        }
+        optimizer.update(deltas.data(), state.first(0), state.second(0), weightCount, learningRate, state.step());
+
+        if(!isLast) {
+            //new errors for new gradient, using weights before the update
+            prevErrors.assign(cols, 0);
+            for(const auto i : lastLayer->m_active) {
+                const auto& n = lastLayer->m_neurons[i];
+                const auto e = errors[i];
+                for(const auto j : prevLayer->m_active)
+                    prevErrors[j] += n.weight(j) * e;
+            }
+        }
 
-        for(auto j = 0U; j < weights.rows(); j++) {
-            auto& n = lastLayer->m_neurons[j];
-            if(n.isActive()) {
-                for(auto i = 0U; i < weights.cols() ; i++) {
-                    if((*prevLayer)[i].isActive())
-                        n.setWeight(i, weights(i, j));
+        // update weights of active neurons from active inputs, a stateless optimizer keeps the zero deltas zero
+        // and then only the nonzero inputs are updated (they are active as dropped inputs are zero)
+        const auto& columns = sparse && optimizer.stateCount() == 0 ? lastLayer->m_nonZero : prevLayer->m_active;
+        if(lastLayer->m_pruned) {
+            // pruned weights stay zero, the compressed rows are stale from now on
+            lastLayer->m_csr.reset();
+            for(const auto i : lastLayer->m_active) {
+                auto& n = neurons[i];
+                const auto row = deltas.begin() + static_cast<long>(i * cols);
+                for(const auto j : columns) {
+                    if(n.weight(j) != 0)
+                        n.setWeight(j, n.weight(j) + row[j]);
                 }
             }
+        } else {
+            for(const auto i : lastLayer->m_active) {
+                auto& n = neurons[i];
+                const auto row = deltas.begin() + static_cast<long>(i * cols);
+                for(const auto j : columns)
+                    n.setWeight(j, n.weight(j) + row[j]);
+            }
         }
 
-        //new errors for new gradient
-        errors = Matrix<NeuronType>::multiply(weightsDataTransposed, errors);
-
-        //next layer to go
-        lastLayer = previousLayer(lastLayer);
-
-        if(lastLayer == nullptr || lastLayer->isInput()) {
-            break; //we hit the input layer
+        if(isLast) {
+            break; //we hit the input or a frozen layer
         }
 
-        lastValues = layerData; //layerdata is output values from previous (or actually next :-) layer
-        //get previous layer weights
-        layerData = Matrix<NeuronType>::fromArray(previousLayer(lastLayer)->m_outBuffer, Matrix<NeuronType>::VecDir::row);
-
+        //next layer to go
+        lastLayer = prevLayer;
+        lastValues = &layerData; //layerdata is output values from previous (or actually next :-) layer
+        errors.swap(prevErrors);
     }
     return true;
 }
 
 constexpr char H5[] = {'N', 'E', 'U', '0', '0', '0', '0', '5'};
+constexpr char H6[] = {'N', 'E', 'U', '0', '0', '0', '0', '6'}; // as H5, but each layer tells its Storage
 //constexpr char H2[] = {'N', 'E', 'U', '0', '0', '0', '0', '2'};
 //constexpr char H3[] = {'N', 'E', 'U', '0', '0', '0', '0', '3'};
 
@@ -578,9 +646,37 @@ static bool Hcomp(const std::string& h, const char* H = H5) {
     return true;
 }
 
+// how layer weights are stored in H6
+enum class Storage : uint8_t {Dense, PrunedDense, Compressed};
+
+bool Layer::isStoredSparse(SaveType saveType) const {
+    if(!m_pruned || isInput()) {
+        return false;
+    }
+    const auto valueSize = data_sz(saveType);
+    size_t weights = 0;
+    size_t nonZero = 0;
+    for(const auto& n : m_neurons) {
+        weights += n.size();
+        for(auto i = 0U; i < n.size(); i++) {
+            if(n.weight_d(i) != 0)
+                ++nonZero;
+        }
+    }
+    return nonZero * (sizeof(uint32_t) + valueSize) < weights * valueSize;
+}
+
 void Layer::save(std::ofstream& strm, const std::unordered_map<std::string, std::string>& meta, SaveType saveType) const {
+    // H6 is written only if there is a pruned layer, others stay readable as H5 e.g. for Feed
+    auto pruned = false;
+    for(auto layer = inputLayer(); layer != nullptr; layer = layer->m_next.get()) {
+        pruned = pruned || layer->m_pruned;
+    }
     if(isInput()) {
-        write(strm, H5);
+        if(pruned)
+            write(strm, H6);
+        else
+            write(strm, H5);
         write(strm, saveType);
         write<uint8_t>(strm, isBigEndian()); //TODO the endianess as option
         unsigned layers = 1;
@@ -593,19 +689,47 @@ void Layer::save(std::ofstream& strm, const std::unordered_map<std::string, std:
         writeMeta(strm, meta);
     }
 
+    for(auto layer = this; layer != nullptr; layer = layer->m_next.get()) {
+        layer->saveLayer(strm, saveType, pruned);
+    }
+}
+
+void Layer::saveLayer(std::ofstream& strm, SaveType saveType, bool pruned) const {
     write(strm, m_activationFunction.name());
 
     write_fn(saveType)(strm, m_dropOut);
 
+    const auto compressed = isStoredSparse(saveType);
+    if(pruned) {
+        write(strm, compressed ? Storage::Compressed : m_pruned ? Storage::PrunedDense : Storage::Dense);
+    }
+
     const auto sz = static_cast<std::uint32_t >(m_neurons.size());
     write(strm, sz);
 
-    for(const auto& n : m_neurons) {
-        n.save(strm, saveType);
-    }
-
-    if(m_next) {
-        m_next->save(strm, {}, saveType);
+    if(compressed) {
+        // bias, number of nonzero weights, their columns and their values per neuron
+        const auto write_value = write_fn(saveType);
+        write(strm, static_cast<uint32_t>(m_prev->size()));
+        for(const auto& n : m_neurons) {
+            write_value(strm, n.bias());
+            std::vector<uint32_t> columns;
+            for(auto i = 0U; i < n.size(); i++) {
+                if(n.weight(i) != 0)
+                    columns.push_back(i);
+            }
+            write(strm, static_cast<uint32_t>(columns.size()));
+            for(const auto c : columns) {
+                write(strm, c);
+            }
+            for(const auto c : columns) {
+                write_value(strm, n.weight(c));
+            }
+        }
+    } else {
+        for(const auto& n : m_neurons) {
+            n.save(strm, saveType);
+        }
     }
 }
 
@@ -613,7 +737,8 @@ static
 std::optional<Header> read_header(StreamBase& stream) {
     const auto hdr =  stream.read_string(sizeof(H5));
     if(hdr) {
-        if(Hcomp(*hdr)) {
+        const auto version = Hcomp(*hdr, H6) ? 6U : Hcomp(*hdr) ? 5U : 0U;
+        if(version > 0) {
             const auto save_type = stream.read<uint8_t>();
             const auto is_bigendian = stream.read<uint8_t>();
             const auto layer_count = stream.read<uint8_t>();
@@ -623,7 +748,8 @@ std::optional<Header> read_header(StreamBase& stream) {
                 return std::make_optional(Header{
                     static_cast<SaveType>(*save_type),
                     *layer_count,
-                    static_cast<bool>(*is_bigendian)});
+                    static_cast<bool>(*is_bigendian),
+                    version});
             }
         }
 #if 0 // no more comp
@@ -643,13 +769,14 @@ std::optional<Header> read_header(StreamBase& stream) {
     }
 
 std::optional<MetaInfo> Layer::doLoad(StreamBase& strm) {
+    NEUROPIA_TRACE("load");
     const auto header = read_header(strm);
     if(!header) {
         print_error("bad header");
         return std::nullopt;
     }
 
-    const auto [save_type, layer_count, is_big_endian] = header.value();
+    const auto [save_type, layer_count, is_big_endian, version] = header.value();
 
     const auto meta = readMeta(strm);
     if(!meta) {
@@ -657,7 +784,7 @@ std::optional<MetaInfo> Layer::doLoad(StreamBase& strm) {
         return std::nullopt;
     }
 
-    if(layer_count == 0 || !loadLayer(strm, save_type, layer_count - 1)) {
+    if(layer_count == 0 || !loadLayer(strm, save_type, version, layer_count - 1)) {
         print_error("invalid network, layers: " << layer_count);
         return std::nullopt;
     }
@@ -680,7 +807,27 @@ std::optional<MetaInfo> Layer::load(const uint8_t* bytes, size_t sz) {
     }
 
 
-bool Layer::loadLayer(StreamBase &strm, SaveType saveType, unsigned layer_index) {
+bool Layer::loadLayer(StreamBase &strm, SaveType saveType, unsigned version, unsigned layer_index) {
+    if(!readLayer(strm, saveType, version)) {
+        return false;
+    }
+    m_next.reset();
+    auto layer = this;
+    for(auto index = layer_index; index > 0; index--) {
+        auto next = std::make_unique<Layer>();
+        next->m_prev = layer;
+        if(!next->readLayer(strm, saveType, version)) {
+            print_error("Invalid layer " << index);
+            return false;
+        }
+        neuropia_assert_always(next->size() > 0, "Invalid layer");
+        layer->m_next = std::move(next);
+        layer = layer->m_next.get();
+    }
+    return !strm.read<uint8_t>();
+}
+
+bool Layer::readLayer(StreamBase &strm, SaveType saveType, unsigned version) {
     const auto name = strm.read_value<uint8_t>();
     if(!name) {
         print_error("Cannot read activation function");
@@ -697,6 +844,10 @@ bool Layer::loadLayer(StreamBase &strm, SaveType saveType, unsigned layer_index)
         m_activationFunction = reLuFunction;
     else if(eluFunction.name() == *name)
         m_activationFunction = eluFunction;
+    else if(softmaxFunction.name() == *name)
+        m_activationFunction = softmaxFunction;
+    else if(linearFunction.name() == *name)
+        m_activationFunction = linearFunction;
     else {
         print_error("Invalid activation function name " + *name);
         return false;
@@ -711,6 +862,12 @@ bool Layer::loadLayer(StreamBase &strm, SaveType saveType, unsigned layer_index)
 
     m_dropOut = *dropout;
 
+    const auto storage = version >= 6 ? strm.read<uint8_t>() : std::make_optional(static_cast<uint8_t>(Storage::Dense));
+    if(!storage || *storage > static_cast<uint8_t>(Storage::Compressed)) {
+        print_error("Cannot read storage");
+        return false;
+    }
+
     const auto count = strm.read<uint32_t>();
     if(!count) {
         print_error("Cannot read count");
@@ -719,33 +876,70 @@ bool Layer::loadLayer(StreamBase &strm, SaveType saveType, unsigned layer_index)
 
    fill(*count, Neuron(m_activationFunction));
 
-    for(auto& n : m_neurons) {
-        if(!n.loadNeuron(strm, saveType)) {
-            print_error("Invalid neuron");
+    if(static_cast<Storage>(*storage) == Storage::Compressed) {
+        if(!loadCompressed(strm, saveType)) {
+            print_error("Invalid compressed layer");
             return false;
         }
+    } else {
+        for(auto& n : m_neurons.write()) {
+            if(!n.loadNeuron(strm, saveType)) {
+                print_error("Invalid neuron");
+                return false;
+            }
+        }
     }
+    m_pruned = static_cast<Storage>(*storage) != Storage::Dense;
+    compress(false);
+    return true;
+}
+
 
-    if(layer_index > 0) {
-        auto layer = new Layer();
-        if(!layer->loadLayer(strm, saveType, layer_index - 1)) {
-            print_error("Invalid layer " << layer_index);
+bool Layer::loadCompressed(StreamBase& strm, SaveType saveType) {
+    const auto inputs = strm.read<uint32_t>();
+    if(!inputs) {
+        return false;
+    }
+    for(auto& n : m_neurons.write()) {
+        const auto bias = strm.read(saveType);
+        const auto nonZero = strm.read<uint32_t>();
+        if(!bias || !nonZero || *nonZero > *inputs) {
             return false;
         }
-        neuropia_assert_always(layer->size() > 0, "Invalid layer"); 
-        m_next.reset(layer);
-        m_next->m_prev = this;
+        std::vector<uint32_t> columns(*nonZero);
+        for(auto& c : columns) {
+            const auto column = strm.read<uint32_t>();
+            if(!column || *column >= *inputs) {
+                return false;
+            }
+            c = *column;
+        }
+        ValueVector weights(*inputs, 0);
+        for(const auto c : columns) {
+            const auto w = strm.read(saveType);
+            if(!w) {
+                return false;
+            }
+            weights[c] = *w;
+        }
+        n.setWeights(std::move(weights));
+        n.setBias(*bias);
     }
-
-    return (layer_index > 0 || !strm.read<uint8_t>());
+    return !strm.eof();
 }
 
-
 Layer& Layer::operator=(Layer&& other) noexcept {
     m_neurons = std::move(other.m_neurons);
     m_outBuffer.resize(m_neurons.size());
     m_next = std::move(other.m_next);
     m_activationFunction = std::move(other.m_activationFunction);
+    m_frozen = other.m_frozen;
+    m_optimizer = other.m_optimizer;
+    m_optimizerState = std::move(other.m_optimizerState);
+    m_dropped = std::move(other.m_dropped);
+    m_active = std::move(other.m_active);
+    m_pruned = other.m_pruned;
+    m_csr = std::move(other.m_csr);
     if(m_next) {
         m_next->m_prev = this;
     }
@@ -753,39 +947,165 @@ Layer& Layer::operator=(Layer&& other) noexcept {
 }
 
 Layer& Layer::operator=(const Layer& other) noexcept {
+    // layers are assigned in place, hence a network of the same topology reuses its layers
+    auto layer = this;
+    for(auto source = &other;;) {
+        layer->assignLayer(*source);
+        source = source->m_next.get();
+        if(source == nullptr) {
+            break;
+        }
+        if(!layer->m_next) {
+            layer->m_next = std::make_unique<Layer>();
+            layer->m_next->m_prev = layer;
+        }
+        layer = layer->m_next.get();
+    }
+    layer->m_next.reset();
+    return *this;
+}
+
+void Layer::assignLayer(const Layer& other) {
     m_neurons = other.m_neurons;
     m_outBuffer.resize(m_neurons.size());
     m_activationFunction = other.m_activationFunction;
-    if(other.m_next) {
-        m_next = std::make_unique<Layer>(*other.m_next);
+    m_frozen = other.m_frozen;
+    m_optimizer = other.m_optimizer;
+    m_optimizerState = other.m_optimizerState;
+    m_dropped = other.m_dropped;
+    m_active = other.m_active;
+    m_pruned = other.m_pruned;
+    m_csr = other.m_csr;
+}
+
+void Layer::feedLayer(const ValueVector& inputs, ThreadPool& pool, size_t minWork) const {
+    neuropia_assert(!isInput() && m_outBuffer.size() >= m_neurons.size());
+    const auto count = m_neurons.size();
+    const auto sparse = !m_csr && sparseInputs(inputs.begin(), inputs.end());
+    const auto work = m_csr ? m_csr->values.size() : count * (sparse ? m_nonZero.size() : inputs.size());
+    // a part is fed by a thread, waking a thread up costs more than feeding a small layer
+    const auto parts = std::min(static_cast<size_t>(pool.size()), work / std::max<size_t>(minWork, 1));
+    if(parts < 2) {
+        feedNeurons(inputs.begin(), inputs.end(), sparse, 0, count);
+    } else {
+        pool.run(parts, [this, &inputs, sparse, count, parts](size_t begin, size_t end) {
+            feedNeurons(inputs.begin(), inputs.end(), sparse, (begin * count) / parts, (end * count) / parts);
+        });
     }
-    if(m_next) {
-        m_next->m_prev = this;
+    if(m_activationFunction == softmaxFunction) {
+        softmax(m_outBuffer.begin(), m_outBuffer.begin() + static_cast<long>(count));
     }
-    return *this;
+}
+
+const ValueVector& Layer::feedForward(ThreadPool& pool, size_t minWork) const {
+    auto layer = this;
+    // run returns when all parts are fed, hence the next layer has its inputs
+    for(; layer->m_next != nullptr; layer = layer->m_next.get()) {
+        layer->m_next->feedLayer(layer->m_outBuffer, pool, minWork);
+    }
+    return layer->m_outBuffer;
 }
 
 void Layer::merge(const Layer& other, NeuronType factor) {
-    neuropia_assert(other.size() == size());
     neuropia_assert(factor >= 0 && factor <= 1.0);
-    if(!isInput()) {
-        for(auto n = 0U ; n < m_neurons.size(); n++) {
-            auto& nThis = m_neurons[n];
-            auto& nOther = other.m_neurons[n];
-            for(auto i = 0U; i < nThis.size(); i++) {
-                nThis.setWeight(i, static_cast<NeuronType>(nThis.weight(i) * (1. - factor)
-                                + nOther.weight(i) * factor));
+    auto source = &other;
+    for(auto layer = this; layer != nullptr; layer = layer->m_next.get(), source = source->m_next.get()) {
+        neuropia_assert(source != nullptr && source->size() == layer->size());
+        if(!layer->isInput()) {
+            auto& neurons = layer->m_neurons.write();
+            for(auto n = 0U ; n < neurons.size(); n++) {
+                auto& nThis = neurons[n];
+                auto& nOther = source->m_neurons[n];
+                for(auto i = 0U; i < nThis.size(); i++) {
+                    nThis.setWeight(i, static_cast<NeuronType>(nThis.weight(i) * (1. - factor)
+                                    + nOther.weight(i) * factor));
+                }
+                nThis.setBias(nThis.bias() * (1 - factor) + nOther.bias() * factor);
             }
-            nThis.setBias(nThis.bias() * (1 - factor) + nOther.bias() * factor);
+            layer->compress(false);
+            layer->m_optimizerState.merge(source->m_optimizerState, factor);
         }
     }
-    if(m_next) {
-        neuropia_assert(other.m_next);
-        m_next->merge(*other.m_next, factor);
-    }
 }
 
 
+void Layer::mergeAll(const std::vector<Layer>& replicas, const ValueVector& factors, ThreadPool* pool) {
+    neuropia_assert_always(!replicas.empty() && (factors.empty() || factors.size() == replicas.size()), "Bad replicas");
+    const auto total = factors.empty() ? static_cast<NeuronType>(replicas.size()) : std::accumulate(factors.begin(), factors.end(), NeuronType{0});
+    neuropia_assert_always(total > 0, "Bad factors");
+    ValueVector scales(replicas.size());
+    for(size_t k = 0; k < replicas.size(); k++) {
+        scales[k] = (factors.empty() ? 1 : factors[k]) / total;
+    }
+
+    // layers of replicas side by side, and the first neuron of each layer as if all neurons were in one vector
+    std::vector<Layer*> layers;
+    std::vector<std::vector<const Layer*>> sources;
+    std::vector<size_t> firstNeurons = {0};
+    std::vector<const Layer*> source;
+    for(const auto& r : replicas) {
+        neuropia_assert_always(&r != this, "Network is a replica");
+        source.push_back(&r);
+    }
+    for(auto layer = this; layer != nullptr; layer = layer->m_next.get()) {
+        for(auto& s : source) {
+            neuropia_assert_always(s != nullptr && s->size() == layer->size(), "Replicas differ");
+        }
+        if(!layer->isInput()) {
+            layer->m_neurons.write(); // shared neurons are copied here, not in parallel
+            layers.push_back(layer);
+            sources.push_back(source);
+            firstNeurons.push_back(firstNeurons.back() + layer->size());
+        }
+        for(auto& s : source) {
+            s = s->m_next.get();
+        }
+    }
+
+    const auto average = [&](size_t begin, size_t end) {
+        auto l = static_cast<size_t>(std::distance(firstNeurons.begin(), std::upper_bound(firstNeurons.begin(), firstNeurons.end(), begin))) - 1;
+        for(auto index = begin; index < end; index++) {
+            while(index >= firstNeurons[l + 1])
+                ++l;
+            const auto n = index - firstNeurons[l];
+            auto& neuron = layers[l]->m_neurons.write()[n];
+            auto weights = neuron.m_weights.data();
+            const auto sz = neuron.m_weights.size();
+            NeuronType bias = 0;
+            // a plain loop per replica, the compiler vectorizes it and the row stays in cache for the next replica
+            for(size_t k = 0; k < scales.size(); k++) {
+                const auto& other = (*sources[l][k]).m_neurons[n];
+                neuropia_assert(other.m_weights.size() == sz);
+                const auto values = other.m_weights.data();
+                const auto scale = scales[k];
+                if(k == 0) {
+                    for(size_t i = 0; i < sz; i++)
+                        weights[i] = values[i] * scale;
+                } else {
+                    for(size_t i = 0; i < sz; i++)
+                        weights[i] += values[i] * scale;
+                }
+                bias += other.m_bias * scale;
+            }
+            neuron.m_bias = bias;
+        }
+    };
+    if(pool != nullptr) {
+        pool->run(firstNeurons.back(), average);
+    } else {
+        average(0, firstNeurons.back());
+    }
+
+    for(size_t l = 0; l < layers.size(); l++) {
+        std::vector<const OptimizerState*> states;
+        for(const auto s : sources[l]) {
+            states.push_back(&s->m_optimizerState);
+        }
+        layers[l]->m_optimizerState.average(states, scales);
+        layers[l]->compress(false);
+    }
+}
+
 int Layer::compare(const Layer& other) const {
     if(other.size() < size()) {
         return std::numeric_limits<int>::min();
@@ -815,82 +1135,77 @@ int Layer::compare(const Layer& other) const {
 }
 
 Layer::~Layer() {
+    // following layers are released one by one, a long chain does not recurse
+    auto next = std::move(m_next);
+    while(next) {
+        next = std::move(next->m_next);
+    }
 }
 
 void Layer::initialize(InitStrategy strategy) {
-    
-    if(!isInput()) {  //actually not needed as setweights wont do notting for input layers
-        NeuronType r = 0;
-        switch (strategy) {
-        case Layer::InitStrategy::Norm:
-            r = 1.0;
-            break;
-        case Layer::InitStrategy::Logistic:
-             r = static_cast<NeuronType>(std::sqrt(6.0 / static_cast<double>(m_neurons.size() + m_prev->m_neurons.size())));
-            break;
-        case Layer::InitStrategy::ReLu:
-             r = static_cast<NeuronType>(std::sqrt(2.0) *  std::sqrt(6.0 / static_cast<double>(m_neurons.size() + m_prev->m_neurons.size())));
-            break;
-        default:
-            neuropia_assert_always(false, "bad");        
-        }
+    const auto run = Philox::run();
+    auto layerDepth = depth();
+    for(auto layer = this; layer != nullptr; layer = layer->m_next.get(), ++layerDepth) {
+        layer->m_pruned = false;
+        layer->m_csr = {};
+        if(!layer->isInput()) {  //actually not needed as setweights wont do notting for input layers
+            const auto fanSum = static_cast<double>(layer->m_neurons.size() + layer->m_prev->m_neurons.size());
+            NeuronType r = 0;
+            switch (strategy) {
+            case Layer::InitStrategy::Norm:
+                r = 1.0;
+                break;
+            case Layer::InitStrategy::Logistic:
+                 r = static_cast<NeuronType>(std::sqrt(6.0 / fanSum));
+                break;
+            case Layer::InitStrategy::ReLu:
+                 r = static_cast<NeuronType>(std::sqrt(2.0) *  std::sqrt(6.0 / fanSum));
+                break;
+            default:
+                neuropia_assert_always(false, "bad");
+            }
 
-        unsigned seed =
-#ifndef RANDOM_SEED
-                static_cast<unsigned>(std::chrono::system_clock::now().time_since_epoch().count())
-#else
-                RANDOM_SEED
-#endif
-                ;
-        std::default_random_engine rd(seed);  //Will be used to obtain a seed for the random number engine
-        std::mt19937 gen(rd()); //Standard mersenne_twister_engine seeded with rd()
-        std::uniform_real_distribution<> dis(-r, r);
-
-        for(auto& n : m_neurons) {
-            for(size_t i = 0; i < n.size(); i++) {
-                n.setWeight(i, static_cast<NeuronType>(dis(gen)));
+            auto gen = Philox::stream(Philox::Stream::Initialize, run, layerDepth); // each layer has own stream
+            std::uniform_real_distribution<> dis(-r, r);
+
+            for(auto& n : layer->m_neurons.write()) {
+                for(size_t i = 0; i < n.size(); i++) {
+                    n.setWeight(i, static_cast<NeuronType>(dis(gen)));
+                }
+            }
+            for(auto& n : layer->m_neurons.write()) { //for certain testability reasons we have second loop to set biases
+                n.setBias(static_cast<NeuronType>(dis(gen)));
+            }
+        } else {
+            for(auto& n : layer->m_neurons.write()) {
+                n.setBias(0);
             }
         }
-        for(auto& n : m_neurons) { //for certain testability reasons we have second loop to set biases
-            n.setBias(static_cast<NeuronType>(dis(gen)));
-        }
-    } else {
-        for(auto& n : m_neurons) {
-            n.setBias(0);
-        }
-    }
-    if(m_next) {
-        m_next->initialize(strategy);
     }
 }
 
-void Layer::dropout(std::default_random_engine& gen) {
-    if(m_dropOut > 0.0) {
-        if(!isOutput()) { // outputs are not dropped
-            const auto sz = static_cast<unsigned>(m_neurons.size());
-            const auto dropCount = static_cast<unsigned>(static_cast<NeuronType>(sz) * m_dropOut);
-            std::vector<bool> set(sz);
-            std::fill(set.begin(), set.end(), false);
-            auto count = 0U;
-            while(count < dropCount) {
-                auto index = gen() % sz;
-                while(set[index]) {
-                    ++index;
-                if(index >= sz)
-                    index = 0;
-                }
-                set[index] = true;
-                ++count;
-            }
-            for(auto i = 0U; i < sz; i++) {
-                auto& n = m_neurons[i];
-                if(set[i])
-                    n.setActivationFunction(nullptr); // turn off
-                else {
-                    n.setActivationFunction(m_activationFunction);
-                }
-            }
+void Layer::dropout(Philox& gen) {
+    const auto sz = static_cast<unsigned>(m_neurons.size());
+    if(m_dropOut > 0.0 && !m_frozen && !isOutput()) { // frozen layers are not dropped, their output is fixed, outputs are not dropped
+        const auto dropCount = static_cast<unsigned>(static_cast<NeuronType>(sz) * m_dropOut);
+        // partial Fisher-Yates shuffle picks the dropped neurons
+        m_active.resize(sz);
+        std::iota(m_active.begin(), m_active.end(), 0U);
+        m_dropped.assign(sz, 0);
+        for(auto i = 0U; i < dropCount; i++) {
+            const auto pick = std::uniform_int_distribution<unsigned>(i, sz - 1)(gen);
+            std::swap(m_active[i], m_active[pick]);
+            m_dropped[m_active[i]] = 1;
+        }
+        m_active.clear();
+        for(auto i = 0U; i < sz; i++) {
+            if(!m_dropped[i])
+                m_active.push_back(i);
         }
+    } else if(!m_dropped.empty() || m_active.size() != sz) {
+        m_dropped.clear();
+        m_active.resize(sz);
+        std::iota(m_active.begin(), m_active.end(), 0U);
     }
     if(m_next)
         m_next->dropout(gen);
@@ -899,8 +1214,10 @@ void Layer::dropout(std::default_random_engine& gen) {
 void Layer::inverseDropout(bool inherit) {
     if(!isOutput() && m_dropOut > 0.0) {
         const auto dropKeepRate =  static_cast<NeuronType>(1.0 / (1.0 - m_dropOut));
-        for(auto& n : m_neurons) {
-            n.setActivationFunction(m_activationFunction);
+        m_dropped.clear();
+        m_active.resize(m_neurons.size());
+        std::iota(m_active.begin(), m_active.end(), 0U);
+        for(auto& n : m_neurons.write()) {
             for(auto i = 0U; i < n.size(); i++) {
                 const auto weight = n.weight(i) * dropKeepRate;
                 n.setWeight(i, weight);
@@ -908,40 +1225,304 @@ void Layer::inverseDropout(bool inherit) {
         }
         m_dropOut = 0.0;
     }
+    compress(false);
     if(m_next && inherit)
         m_next->inverseDropout();
 }
 
+Layer Layer::inferenceCopy() const {
+    Layer copy(*this);
+    auto target = &copy;
+    for(auto layer = this; layer != nullptr; layer = layer->m_next.get()) {
+        target->m_dropOut = layer->m_dropOut; // not copied with the layer
+        target = target->m_next.get();
+    }
+    copy.inverseDropout();
+    return copy;
+}
+
+void Layer::setActivationFunction(const ActivationFunction& activationFunction) {
+    m_activationFunction = activationFunction;
+    for(auto& n : m_neurons.write()) {
+        if(n.isActive()) { // neurons without a function are left as is
+            n.setActivationFunction(m_activationFunction);
+        }
+    }
+}
+
+void Layer::setOptimizer(const Optimizer& optimizer, bool inherit) {
+    m_optimizer = optimizer;
+    m_optimizerState.clear();
+    if(inherit && m_next)
+        m_next->setOptimizer(optimizer, inherit);
+}
+
+void Layer::prune(NeuronType sparsity, bool inherit) {
+    neuropia_assert_always(sparsity >= 0.0 && sparsity < 1.0, "sparsity >= 0 && sparsity < 1.0");
+    if(!isInput() && sparsity > 0.0) {
+        ValueVector magnitudes;
+        for(const auto& n : m_neurons) {
+            for(auto i = 0U; i < n.size(); i++)
+                magnitudes.push_back(std::abs(n.weight(i)));
+        }
+        const auto count = static_cast<size_t>(sparsity * static_cast<NeuronType>(magnitudes.size()));
+        if(count > 0) {
+            std::nth_element(magnitudes.begin(), magnitudes.begin() + static_cast<long>(count - 1), magnitudes.end());
+            const auto threshold = magnitudes[count - 1];
+            // weights below the threshold are pruned, and then equal ones until the count is met
+            auto ties = count - static_cast<size_t>(std::count_if(magnitudes.begin(), magnitudes.end(), [threshold](auto m) {return m < threshold;}));
+            for(auto& n : m_neurons.write()) {
+                for(auto i = 0U; i < n.size(); i++) {
+                    const auto m = std::abs(n.weight(i));
+                    if(m < threshold) {
+                        n.setWeight(i, 0);
+                    } else if(m == threshold && ties > 0) {
+                        n.setWeight(i, 0);
+                        --ties;
+                    }
+                }
+            }
+        }
+        m_pruned = true;
+        compress(false);
+    }
+    if(inherit && m_next)
+        m_next->prune(sparsity, inherit);
+}
+
+NeuronType Layer::sparsity() const {
+    size_t weights = 0;
+    size_t zeros = 0;
+    for(const auto& n : m_neurons) {
+        weights += n.size();
+        for(auto i = 0U; i < n.size(); i++) {
+            if(n.weight_d(i) == 0)
+                ++zeros;
+        }
+    }
+    return weights > 0 ? static_cast<NeuronType>(zeros) / static_cast<NeuronType>(weights) : 0;
+}
+
+void Layer::compress(bool inherit) {
+    m_csr.reset();
+    if(m_pruned && !isInput()) {
+        Csr csr;
+        csr.offsets.push_back(0);
+        for(const auto& n : m_neurons) {
+            for(auto i = 0U; i < n.size(); i++) {
+                if(n.weight(i) != 0) {
+                    csr.columns.push_back(i);
+                    csr.values.push_back(n.weight(i));
+                }
+            }
+            csr.offsets.push_back(static_cast<uint32_t>(csr.columns.size()));
+        }
+        m_csr = std::make_shared<const Csr>(std::move(csr));
+    }
+    if(inherit && m_next)
+        m_next->compress(inherit);
+}
+
+// Eigen decomposition of a symmetric matrix by cyclic Jacobi rotations, the matrix is diagonalized in place
+// and its eigenvectors are returned as columns
+static std::vector<ValueVector> eigenVectors(std::vector<ValueVector>& a) {
+    const auto n = a.size();
+    std::vector<ValueVector> v(n, ValueVector(n, 0));
+    for(auto i = 0U; i < n; i++)
+        v[i][i] = 1;
+    for(auto sweep = 0U; sweep < 64; sweep++) {
+        NeuronType off = 0;
+        NeuronType diagonal = 0;
+        for(auto p = 0U; p < n; p++) {
+            diagonal += a[p][p] * a[p][p];
+            for(auto q = p + 1; q < n; q++)
+                off += a[p][q] * a[p][q];
+        }
+        if(off <= std::numeric_limits<NeuronType>::epsilon() * std::numeric_limits<NeuronType>::epsilon() * diagonal)
+            break;
+        for(auto p = 0U; p < n; p++) {
+            for(auto q = p + 1; q < n; q++) {
+                if(a[p][q] == 0)
+                    continue;
+                const auto theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+                const auto t = static_cast<NeuronType>(theta >= 0 ? 1 : -1) / (std::abs(theta) + std::sqrt(theta * theta + 1));
+                const auto c = 1 / std::sqrt(t * t + 1);
+                const auto s = t * c;
+                for(auto k = 0U; k < n; k++) {
+                    const auto kp = a[k][p];
+                    const auto kq = a[k][q];
+                    a[k][p] = c * kp - s * kq;
+                    a[k][q] = s * kp + c * kq;
+                }
+                for(auto k = 0U; k < n; k++) {
+                    const auto pk = a[p][k];
+                    const auto qk = a[q][k];
+                    a[p][k] = c * pk - s * qk;
+                    a[q][k] = s * pk + c * qk;
+                }
+                for(auto k = 0U; k < n; k++) {
+                    const auto kp = v[k][p];
+                    const auto kq = v[k][q];
+                    v[k][p] = c * kp - s * kq;
+                    v[k][q] = s * kp + c * kq;
+                }
+            }
+        }
+    }
+    return v;
+}
+
+Layer& Layer::factorize(size_t rank) {
+    neuropia_assert_always(!isInput(), "Input layer has no weights");
+    const auto rows = m_neurons.size();
+    const auto cols = m_prev->size();
+    neuropia_assert_always(rank > 0 && rank <= std::min(rows, cols), "Bad rank");
+    // W = U * S * V', the smaller Gram matrix of W is decomposed, its eigenvectors are the singular vectors of that side
+    // and the other side is projected from W. The projection keeps the singular values, i.e. it is the truncated product.
+    const auto byRows = rows <= cols;
+    const auto side = byRows ? rows : cols;
+    const auto w = [this, byRows](size_t i, size_t k) {return byRows ? m_neurons[i].weight(k) : m_neurons[k].weight(i);};
+    const auto length = byRows ? cols : rows;
+    std::vector<ValueVector> gram(side, ValueVector(side, 0));
+    for(auto i = 0U; i < side; i++) {
+        for(auto j = i; j < side; j++) {
+            NeuronType sum = 0;
+            for(auto k = 0U; k < length; k++)
+                sum += w(i, k) * w(j, k);
+            gram[i][j] = sum;
+            gram[j][i] = sum;
+        }
+    }
+    const auto vectors = eigenVectors(gram);
+    std::vector<unsigned> order(side);
+    std::iota(order.begin(), order.end(), 0U);
+    std::sort(order.begin(), order.end(), [&gram](auto a, auto b) {return gram[a][a] > gram[b][b];});
+
+    auto inserted = new Layer(rank, linearFunction, Neuron(linearFunction));
+    inserted->m_optimizer = m_optimizer;
+    for(auto r = 0U; r < rank; r++) {
+        const auto e = order[r];
+        ValueVector v(cols, 0);
+        if(byRows) {
+            for(auto i = 0U; i < rows; i++) {
+                const auto& n = m_neurons[i];
+                for(auto j = 0U; j < cols; j++)
+                    v[j] += vectors[i][e] * n.weight(j);
+            }
+        } else {
+            for(auto j = 0U; j < cols; j++)
+                v[j] = vectors[j][e];
+        }
+        auto& neuron = inserted->m_neurons.write()[r];
+        neuron.setWeights(std::move(v));
+        neuron.setBias(0);
+    }
+    auto& neurons = m_neurons.write();
+    for(auto i = 0U; i < rows; i++) {
+        auto& n = neurons[i];
+        ValueVector u(rank, 0);
+        for(auto r = 0U; r < rank; r++) {
+            const auto e = order[r];
+            if(byRows) {
+                u[r] = vectors[i][e];
+            } else {
+                for(auto j = 0U; j < cols; j++)
+                    u[r] += n.weight(j) * vectors[j][e];
+            }
+        }
+        n.setWeights(std::move(u));
+    }
+    m_pruned = false;
+    m_csr = {};
+    m_optimizerState.clear();
+
+    auto prev = m_prev;
+    inserted->m_next = std::move(prev->m_next);
+    inserted->m_prev = prev;
+    prev->m_next.reset(inserted);
+    m_prev = inserted;
+    return *inserted;
+}
+
+void Layer::removeNeurons(const std::vector<unsigned>& indices, const ValueVector& means) {
+    neuropia_assert_always(!isInput() && !isOutput(), "Only hidden neurons can be removed");
+    neuropia_assert_always(means.empty() || means.size() == m_neurons.size(), "Bad means");
+    std::vector<uint8_t> removed(m_neurons.size(), 0);
+    for(const auto i : indices) {
+        neuropia_assert_always(i < m_neurons.size(), "Bad index");
+        removed[i] = 1;
+    }
+    for(auto& n : m_next->m_neurons.write()) {
+        ValueVector weights;
+        auto bias = n.bias();
+        for(auto i = 0U; i < n.size(); i++) {
+            if(!removed[i])
+                weights.push_back(n.weight(i));
+            else if(!means.empty())
+                bias += n.weight(i) * means[i];
+        }
+        n.setWeights(std::move(weights));
+        n.setBias(bias);
+    }
+    std::vector<Neuron> neurons;
+    for(auto i = 0U; i < m_neurons.size(); i++) {
+        if(!removed[i])
+            neurons.push_back(m_neurons[i]);
+    }
+    m_neurons = std::move(neurons);
+    m_outBuffer.resize(m_neurons.size());
+    m_dropped.clear();
+    m_active.resize(m_neurons.size());
+    std::iota(m_active.begin(), m_active.end(), 0U);
+    m_optimizerState.clear();
+    m_next->m_optimizerState.clear();
+    compress(false);
+    m_next->compress(false);
+}
+
 void Layer::dropout(NeuronType dropoutRate, bool inherit) {
     neuropia_assert_always(dropoutRate >= 0.0 && dropoutRate < 1.0, "dropoutRate >= 0 && dropoutRate < 1.0");
     if(m_dropOut > 0.0) {
         inverseDropout(false);
     }
-    m_dropOut = dropoutRate;
+    m_dropOut = m_frozen ? 0 : dropoutRate;
     if(inherit && m_next)
         m_next->dropout(dropoutRate, inherit);
 }
 
+void Layer::freeze(bool frozen) {
+    if(frozen && m_dropOut > 0.0) {
+        inverseDropout(false);
+    }
+    m_frozen = frozen;
+}
+
 
 Layer* Layer::get(int offset) {
-    if(offset == 0)
-        return this;
-
-    if(offset > 0) {
-        if(m_next)
-            return m_next->get(offset - 1);
+    auto layer = this;
+    for(; offset > 0 && layer != nullptr; offset--) {
+        layer = layer->m_next.get();
     }
-    else if(offset < 0) {
-        if(m_prev)
-            return m_prev->get(offset + 1);
+    for(; offset < 0 && layer != nullptr; offset++) {
+        layer = layer->m_prev;
     }
-    return nullptr;
+    return layer;
 }
 
 const Layer* Layer::get(int offset) const {
     return const_cast<Layer*>(this)->get(offset);
 }
 
+const Layer* Layer::frozenLayer() const {
+    const Layer* frozen = nullptr;
+    for(auto layer = this; layer != nullptr; layer = layer->m_next.get()) {
+        if(layer->m_frozen && !layer->isInput()) {
+            frozen = layer;
+        }
+    }
+    return frozen;
+}
+
 
 bool Layer::isValid(bool testNext) const {
     if(m_outBuffer.empty()) {
@@ -0,0 +1,259 @@
+#include "neuropia_binary.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace Neuropia;
+
+constexpr char HB[] = {'N', 'E', 'U', 'B', '0', '0', '0', '1'};
+
+// layer flags in the file
+constexpr uint8_t SignedInputs = 0x1;
+constexpr uint8_t Inverted = 0x2;
+
+template<typename T>
+static void writeValue(std::ofstream& strm, const T& value) {
+    strm.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<typename T>
+static void writeValues(std::ofstream& strm, const std::vector<T>& values) {
+    strm.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+using DotsFunction = void (*)(const uint32_t*, size_t, size_t, bool, int, const uint32_t*, int, int*);
+
+static ALWAYS_INLINE void layerDots(const uint32_t* weights, size_t words, size_t neurons, bool signedInputs, int inputs, const uint32_t* bits, int setBits, int* counts) {
+    for(size_t n = 0; n < neurons; n++, weights += words) {
+        unsigned count = 0;
+        if(signedInputs) {
+            // XNOR counts matches, dot = matches - mismatches = inputs - 2 * mismatches, unused bits are zero on both
+            for(size_t i = 0; i < words; i++)
+                count += popcount(bits[i] ^ weights[i]);
+            counts[n] = inputs - 2 * static_cast<int>(count);
+        } else {
+            // only set inputs count, each as +1 or -1 by the weight sign
+            for(size_t i = 0; i < words; i++)
+                count += popcount(bits[i] & weights[i]);
+            counts[n] = 2 * static_cast<int>(count) - setBits;
+        }
+    }
+}
+
+static void layerDotsDefault(const uint32_t* weights, size_t words, size_t neurons, bool signedInputs, int inputs, const uint32_t* bits, int setBits, int* counts) {
+    layerDots(weights, words, neurons, signedInputs, inputs, bits, setBits, counts);
+}
+
+// Popcount instructions are not in the x86-64 baseline, hence dot products are compiled for them as well
+// and the variant is selected by the CPU at run time
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+__attribute__((target("popcnt")))
+static void layerDotsPopcnt(const uint32_t* weights, size_t words, size_t neurons, bool signedInputs, int inputs, const uint32_t* bits, int setBits, int* counts) {
+    layerDots(weights, words, neurons, signedInputs, inputs, bits, setBits, counts);
+}
+
+__attribute__((target("popcnt,avx512f,avx512vpopcntdq")))
+static void layerDotsVpopcnt(const uint32_t* weights, size_t words, size_t neurons, bool signedInputs, int inputs, const uint32_t* bits, int setBits, int* counts) {
+    layerDots(weights, words, neurons, signedInputs, inputs, bits, setBits, counts);
+}
+
+bool BinaryNetwork::supports(Kernel kernel) {
+    __builtin_cpu_init();
+    if(kernel == Kernel::Vpopcnt)
+        return __builtin_cpu_supports("avx512vpopcntdq");
+    if(kernel == Kernel::Popcnt)
+        return __builtin_cpu_supports("popcnt");
+    return true;
+}
+
+static DotsFunction kernelDots(BinaryNetwork::Kernel kernel) {
+    if(kernel == BinaryNetwork::Kernel::Vpopcnt)
+        return &layerDotsVpopcnt;
+    if(kernel == BinaryNetwork::Kernel::Popcnt)
+        return &layerDotsPopcnt;
+    return &layerDotsDefault;
+}
+
+static DotsFunction selectDots() {
+    if(BinaryNetwork::supports(BinaryNetwork::Kernel::Vpopcnt))
+        return &layerDotsVpopcnt;
+    if(BinaryNetwork::supports(BinaryNetwork::Kernel::Popcnt))
+        return &layerDotsPopcnt;
+    return &layerDotsDefault;
+}
+#else
+bool BinaryNetwork::supports(Kernel kernel) {
+    return kernel == Kernel::Auto || kernel == Kernel::Default;
+}
+
+static DotsFunction kernelDots(BinaryNetwork::Kernel) {
+    return &layerDotsDefault;
+}
+
+static DotsFunction selectDots() {
+    return &layerDotsDefault;
+}
+#endif
+
+void BinaryNetwork::dots(const Layer& layer, const uint32_t* bits, int setBits, int* counts, Kernel kernel) {
+    static const auto selected = selectDots();
+    neuropia_assert(supports(kernel));
+    const auto dotsFunction = kernel == Kernel::Auto ? selected : kernelDots(kernel);
+    dotsFunction(layer.weights.data(), layer.words(), layer.neurons, layer.signedInputs, static_cast<int>(layer.inputs), bits, setBits, counts);
+}
+
+// count * scale >= limit as count >= threshold, count is an integer between -inputs and inputs
+static int32_t threshold(NeuronType limit, NeuronType scale, uint32_t inputs) {
+    const auto bound = static_cast<NeuronType>(inputs) + 1;
+    if(scale <= 0)
+        return limit <= 0 ? -static_cast<int32_t>(inputs) - 1 : static_cast<int32_t>(inputs) + 1;
+    return static_cast<int32_t>(std::clamp(std::ceil(limit / scale), -bound, bound));
+}
+
+std::optional<BinaryNetwork> BinaryNetwork::convert(const Neuropia::Layer& network, uint8_t inputThreshold) {
+    BinaryNetwork binary;
+    binary.m_inputThreshold = inputThreshold;
+    auto signedInputs = false; // inputs are 0 or 1
+    for(auto layer = network.next(); layer != nullptr; layer = layer->next()) {
+        const auto af = layer->activationFunction();
+        const auto isSigned = af == signumFunction;
+        if(!layer->isOutput() && !isSigned && af != binaryFunction && af != sigmoidFunction) {
+            std::cerr << "Cannot binarize hidden layer of " << af.name() << std::endl;
+            return std::nullopt;
+        }
+        Layer b = {};
+        b.inputs = static_cast<uint32_t>(layer->get(-1)->size());
+        b.neurons = static_cast<uint32_t>(layer->size());
+        b.signedInputs = signedInputs;
+        // binaryFunction is 1 below 1, others activate at zero
+        b.inverted = af == binaryFunction;
+        const auto limit = static_cast<NeuronType>(b.inverted ? 1 : 0);
+        const auto words = b.words();
+        b.weights.assign(b.neurons * words, 0);
+        for(auto i = 0U; i < b.neurons; i++) {
+            const auto& n = (*layer)[i];
+            NeuronType magnitude = 0;
+            for(auto j = 0U; j < b.inputs; j++) {
+                const auto w = n.weight(j);
+                magnitude += std::abs(w);
+                if(w >= 0)
+                    b.weights[i * words + j / WordBits] |= 1U << (j % WordBits);
+            }
+            const auto scale = b.inputs > 0 ? magnitude / static_cast<NeuronType>(b.inputs) : 0;
+            if(layer->isOutput()) {
+                b.scales.push_back(static_cast<float>(scale));
+                b.biases.push_back(static_cast<float>(n.bias()));
+            } else {
+                b.thresholds.push_back(threshold(limit - n.bias(), scale, b.inputs));
+            }
+        }
+        binary.m_layers.push_back(std::move(b));
+        signedInputs = isSigned;
+    }
+    if(binary.m_layers.empty()) {
+        std::cerr << "Network has no layers" << std::endl;
+        return std::nullopt;
+    }
+    return binary;
+}
+
+size_t BinaryNetwork::bytes() const {
+    size_t sz = 0;
+    for(const auto& layer : m_layers) {
+        sz += layer.weights.size() * sizeof(uint32_t) + layer.thresholds.size() * sizeof(int32_t)
+            + layer.scales.size() * sizeof(float) + layer.biases.size() * sizeof(float);
+    }
+    return sz;
+}
+
+bool BinaryNetwork::save(const std::string& filename) const {
+    std::ofstream strm;
+    strm.open(filename, std::ios::out | std::ios::binary);
+    if(!strm.is_open()) {
+        std::cerr << "Cannot write " << filename << std::endl;
+        return false;
+    }
+    strm.write(HB, sizeof(HB));
+    writeValue<uint8_t>(strm, isBigEndian());
+    writeValue<uint8_t>(strm, m_inputThreshold);
+    writeValue(strm, static_cast<uint32_t>(m_layers.size()));
+    for(const auto& layer : m_layers) {
+        writeValue<uint8_t>(strm, static_cast<uint8_t>((layer.signedInputs ? SignedInputs : 0) | (layer.inverted ? Inverted : 0)));
+        writeValue(strm, layer.inputs);
+        writeValue(strm, layer.neurons);
+        writeValues(strm, layer.thresholds);
+        writeValues(strm, layer.scales);
+        writeValues(strm, layer.biases);
+        writeValues(strm, layer.weights);
+    }
+    return strm.good();
+}
+
+std::optional<BinaryNetwork> BinaryNetwork::load(const std::string& filename) {
+    std::ifstream strm;
+    strm.open(filename, std::ios::in | std::ios::binary);
+    if(!strm.is_open()) {
+        std::cerr << "filename " << filename << " cannot be opened" << std::endl;
+        return std::nullopt;
+    }
+    const std::vector<uint8_t> data((std::istreambuf_iterator<char>(strm)), std::istreambuf_iterator<char>());
+    return load(data.data(), data.size());
+}
+
+std::optional<BinaryNetwork> BinaryNetwork::load(const uint8_t* bytes, size_t sz) {
+    size_t pos = 0;
+    const auto read = [bytes, sz, &pos](void* target, size_t size) {
+        if(sz - pos < size)
+            return false;
+        std::memcpy(target, bytes + pos, size);
+        pos += size;
+        return true;
+    };
+    const auto readValues = [&read, sz, &pos](auto& values, size_t count) {
+        if((sz - pos) / sizeof(values[0]) < count)
+            return false;
+        values.resize(count);
+        return read(values.data(), count * sizeof(values[0]));
+    };
+
+    char header[sizeof(HB)];
+    uint8_t bigEndian = 0;
+    uint32_t count = 0;
+    BinaryNetwork binary;
+    if(!read(header, sizeof(header)) || std::memcmp(header, HB, sizeof(HB)) != 0) {
+        std::cerr << "Not a binary network" << std::endl;
+        return std::nullopt;
+    }
+    if(!read(&bigEndian, sizeof(bigEndian)) || static_cast<bool>(bigEndian) != isBigEndian()
+        || !read(&binary.m_inputThreshold, sizeof(binary.m_inputThreshold)) || !read(&count, sizeof(count)) || count == 0) {
+        std::cerr << "Invalid binary network" << std::endl;
+        return std::nullopt;
+    }
+    for(auto l = 0U; l < count; l++) {
+        Layer layer = {};
+        uint8_t flags = 0;
+        if(!read(&flags, sizeof(flags)) || !read(&layer.inputs, sizeof(layer.inputs)) || !read(&layer.neurons, sizeof(layer.neurons))) {
+            std::cerr << "Cannot read layer " << l << std::endl;
+            return std::nullopt;
+        }
+        layer.signedInputs = flags & SignedInputs;
+        layer.inverted = flags & Inverted;
+        const auto isOutput = l + 1 == count;
+        if(!readValues(layer.thresholds, isOutput ? 0 : layer.neurons)
+            || !readValues(layer.scales, isOutput ? layer.neurons : 0)
+            || !readValues(layer.biases, isOutput ? layer.neurons : 0)
+            || !readValues(layer.weights, layer.neurons * layer.words())
+            || (!binary.m_layers.empty() && binary.m_layers.back().neurons != layer.inputs)) {
+            std::cerr << "Cannot read layer " << l << std::endl;
+            return std::nullopt;
+        }
+        binary.m_layers.push_back(std::move(layer));
+    }
+    return binary;
+}
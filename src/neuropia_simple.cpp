@@ -120,6 +120,7 @@ bool NeuropiaSimple::train(const NeuropiaPtr& env, TrainType type) {
         return false;
     }
     trainer->train();
+    env->m_profile = trainer->profile();
     env->m_network = std::move(trainer->network());
    return true;
 }
@@ -163,6 +164,11 @@ void NeuropiaSimple::setLogger(const NeuropiaPtr& env, std::function<void (const
 }
 
 
+Neuropia::Profiler::Stats NeuropiaSimple::profile(const NeuropiaPtr& env) {
+    ASSERT(env);
+    return env->m_profile;
+}
+
 const Layer& NeuropiaSimple::network(const NeuropiaPtr& env) {
     return env->m_network;
 }
@@ -1,7 +1,7 @@
-#include <thread>
 #include "utils.h"
 #include "paralleltrain.h"
 #include "params.h"
+#include "threadpool.h"
 
 using namespace Neuropia;
 
@@ -15,8 +15,9 @@ TrainerParallel::TrainerParallel(const std::string& root, const Neuropia::Params
 bool TrainerParallel::doTrain() {
 //copy network for jobs
     std::vector<Neuropia::Layer> offsprings(m_jobs);
-    std::vector<std::thread> threads(m_jobs);
-    std::vector<std::vector<std::tuple<std::vector<unsigned char>, unsigned char>>> batches(m_jobs);
+    // jobs and merge run on the same threads, hence per thread state, e.g. hardware counters, is set up once
+    ThreadPool pool(m_jobs);
+    std::vector<std::vector<std::tuple<std::vector<unsigned char>, unsigned char, size_t>>> batches(m_jobs);
     for(auto&v : batches)
         for(auto& t : v)
         std::get<0>(t).resize(m_images.size(1) * m_images.size(2));
@@ -26,10 +27,11 @@ bool TrainerParallel::doTrain() {
 
 Neuropia::timed([&]() {
     Neuropia::iterator(this->m_iterations, [&](size_t it)  {
+        NEUROPIA_TRACE("iteration");
         ++progressCount;
 
         if(m_maxTrainTime >= MaxTrainTime) {
-            if(!this->m_quiet)
+            if(progress())
                 std::cout << "\r"
                           << std::setprecision(2) << (100.0 * (static_cast<NeuronType>(progressCount) / static_cast<NeuronType>(load))) << '%' << std::flush;
         } else {
@@ -43,13 +45,17 @@ Neuropia::timed([&]() {
             this->m_gap = delta;
             this->m_learningRate += (static_cast<NeuronType>(change) / static_cast<NeuronType>(this->m_maxTrainTime)) * (this->m_learningRateMin - this->m_learningRateMax);
 
-            if(!this->m_quiet)
+            if(progress())
                 std::cout << "\r"
                           << std::setprecision(3) << (100.0 * (delta / static_cast<NeuronType>(this->m_maxTrainTime))) << '%' << std::flush;
         }
 
         //copy network for jobs
-        std::fill(offsprings.begin(), offsprings.end(), m_network);
+        {
+            NEUROPIA_TRACE("offsprings");
+            const auto scope = m_profiler.scope(Profiler::Phase::Merge);
+            std::fill(offsprings.begin(), offsprings.end(), m_network);
+        }
         const auto inputSize = m_images.size(1) * m_images.size(2);
 
         for(auto job = 0U; job < m_jobs; ++job)  {
@@ -57,36 +63,55 @@ Neuropia::timed([&]() {
             auto& batchData = batches[job];
             batchData.resize(m_batchSize);
 
-            for(auto i = 0U; i < m_batchSize; i++)  {
-                const auto at = m_random.random(m_images.size());
-                batchData[i] = {m_images.readAt(at, inputSize), m_labels.readAt(at)};
+            NEUROPIA_TRACE("batch");
+            {
+                const auto scope = m_profiler.scope(Profiler::Phase::Sampling);
+                for(auto& batch : batchData)  {
+                    std::get<2>(batch) = m_random.random(trainingSize());
+                }
             }
+            {
+                const auto scope = m_profiler.scope(Profiler::Phase::Io);
+                for(auto& [image, label, at] : batchData)  {
+                    image = m_images.readAt(at, inputSize);
+                    label = m_labels.readAt(at);
+                }
+            }
+        }
 
-            // start thread
-            threads[job] = std::thread([&](unsigned currentJob) {
+        pool.run(m_jobs, [&](size_t begin, size_t end) {
+            for(auto currentJob = begin; currentJob < end; currentJob++) {
+                NEUROPIA_TRACE("job");
+                jobStream(1 + it * m_jobs + currentJob);
+                const auto& batchData = batches[currentJob];
                 //first we train
                 for(auto i = 0U; i < m_batchSize; i++) {
 
                     std::vector<Neuropia::NeuronType> inputs(inputSize);
-                    std::transform(std::get<0>(batchData[i]).begin(), std::get<0>(batchData[i]).end(), inputs.begin(), [](unsigned char c) {
-                        return Neuropia::normalize(static_cast<Neuropia::NeuronType>(c), 0, 255);
-                    });
-
                     std::vector<Neuropia::NeuronType> outputs(m_network.outLayer()->size());
-                    outputs[std::get<1>(batchData[i])] = 1.0;
-
-                    offsprings[currentJob].train(inputs.begin(), outputs.begin(), this->m_learningRate, this->m_lambdaL2);
+                    {
+                        const auto scope = m_profiler.scope(Profiler::Phase::Normalization);
+                        std::transform(std::get<0>(batchData[i]).begin(), std::get<0>(batchData[i]).end(), inputs.begin(), [](unsigned char c) {
+                            return Neuropia::normalize(static_cast<Neuropia::NeuronType>(c), 0, 255);
+                        });
+                        outputs[std::get<1>(batchData[i])] = 1.0;
+                    }
+
+                    trainSample(offsprings[currentJob], std::get<2>(batchData[i]), inputs, outputs);
                 }
-             // end thread
-            }, job);
-        }
-        for(auto& thread : threads) { // wait em all
-            thread.join();
+            }
+        });
+        m_trainedSamples += m_jobs * m_batchSize;
+
+        //then merge the results as the mean of offsprings
+        {
+            NEUROPIA_TRACE("merge");
+            const auto scope = m_profiler.scope(Profiler::Phase::Merge);
+            this->m_network.mergeAll(offsprings, {}, &pool);
         }
 
-        //then merge the results by caclucate each offspring relative contribution
-        for(const auto& offspring : offsprings) {
-            this->m_network.merge(offspring, 1.0 / static_cast<NeuronType>(m_jobs));
+        if(!testVerify(it, m_network)) {
+            return false;
         }
 
         return true;
@@ -95,5 +120,6 @@ Neuropia::timed([&]() {
     std::cout << std::endl;
 }, "Training contributionally");
 this->m_network.inverseDropout();
+trainingEnd();
 return true;
 }
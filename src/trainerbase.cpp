@@ -1,6 +1,7 @@
 #include "trainerbase.h"
 #include "utils.h"
 #include "params.h"
+#include "matrix.h"
 
 /*
 #include <dirent.h>
@@ -90,6 +91,24 @@ auto toInitStrategy(const std::string& strategy, const Neuropia::ActivationFunct
     return Neuropia::initStrategyMap(af);
 }
 
+static
+auto toOptimizer(const Neuropia::Params& p) {
+    const auto name = p["Optimizer"];
+    const auto type =
+            name == "momentum" ? Neuropia::Optimizer::Type::Momentum :
+            name == "nesterov" ? Neuropia::Optimizer::Type::Nesterov :
+            name == "rmsprop" ? Neuropia::Optimizer::Type::RMSProp :
+            name == "adam" ? Neuropia::Optimizer::Type::Adam :
+                             Neuropia::Optimizer::Type::Sgd;
+    return Neuropia::Optimizer(type, p.real("Momentum"), p.real("Beta2"));
+}
+
+static
+auto validationFile(const std::string& root, const Neuropia::Params& p, const std::string& validationKey, const std::string& trainKey) {
+    // without ValidationImages a slice of the training data is held out
+    return Neuropia::absPath(root, p["ValidationImages"].empty() ? p[trainKey] : p[validationKey]);
+}
+
 static
 auto lrMin(const Neuropia::Params & p) {
     return p["LearningRate"] == "0" ? std::stod(p["LearningRateMin"]) : std::stod(p["LearningRate"]);
@@ -120,15 +139,54 @@ TrainerBase::TrainerBase(const std::string & root, const Neuropia::Params& param
     m_topology(toIntVec(params["Topology"])),
     m_afs(toFunction(params["ActivationFunction"])),
     m_initStrategy(toInitStrategy(params["InitStrategy"], toFunction(params["ActivationFunction"])[0])),
+    m_freeze(toIntVec(params["Freeze"])),
+    m_freezeCache(params.boolean("FreezeCache")),
+    m_optimizer(toOptimizer(params)),
+    m_softmax(params.boolean("Softmax")),
     m_maxTrainTime(params.real("MaxTrainTime")), m_control(m_maxTrainTime >= MaxTrainTime ?
                                            static_cast<decltype (m_control)>(Neuropia::timed) :
                                            static_cast<decltype (m_control)>([this](const std::function<void ()>& f, const std::string & label) {
                                                f();
                                                std::cout << (!label.empty() ? label + " " : "") << "iterations:" << m_passedIterations << std::endl;
-                                               })){}
+                                               })),
+    m_validationImageFile(validationFile(root, params, "ValidationImages", "Images")),
+    m_validationLabelFile(validationFile(root, params, "ValidationLabels", "Labels")),
+    m_holdOut(params["ValidationImages"].empty()),
+    m_validationSize(params.uinteger("ValidationSize")),
+    m_earlyStopPatience(params.uinteger("EarlyStopPatience")),
+    m_earlyStopDelta(params.real("EarlyStopDelta")),
+    m_earlyStopLoss(params["EarlyStopMetric"] == "loss"),
+    m_targetAccuracy(params.real("TargetAccuracy")),
+    m_progress(std::chrono::milliseconds(params.uinteger("ProgressInterval"))),
+    m_arena(params.boolean("Arena")),
+    m_prune(params.real("Prune")),
+    m_pruneCycles(params.uinteger("PruneCycles")),
+    m_pruneIterations(params.uinteger("PruneIterations")),
+    m_rank(params.uinteger("Rank")),
+    m_rankIterations(params.uinteger("RankIterations")) {
+    // a later trainer of the same Seed continues its runs, e.g. ensemble members differ, yet the process is reproducible
+    if(params.uinteger("Seed") > 0 && params.uinteger("Seed") != Philox::seed()) {
+        Philox::setSeed(params.uinteger("Seed"));
+    }
+    m_run = Philox::run(); // after the seed is set
+    m_random = Neuropia::Random();
+    m_profiler.enable(params.boolean("Profile"));
+    m_profiler.enableCounters(params.boolean("Profile") && params.boolean("ProfileCounters"));
+#ifndef STD_ALLOCATOR
+    MatrixAllocatorBase::setCapacity(static_cast<size_t>(params.uinteger("MatrixPoolCapacity")) * 1024 * 1024);
+#else
+    if(m_arena) {
+        std::cerr << "Arena is not available with STD_ALLOCATOR" << std::endl;
+    }
+#endif
+    if(!params["TraceFile"].empty()) {
+        Trace::instance().start(params["TraceFile"]);
+    }
+}
 
     bool TrainerBase::init() {
         m_passedIterations = 0;
+        jobStream(0);
         if(!m_images.ok()) {
             std::cerr << "Cannot open images from \"" << m_imageFile << "\"" << std::endl;
             return false;
@@ -161,27 +219,203 @@ TrainerBase::TrainerBase(const std::string & root, const Neuropia::Params& param
         npt->setActivationFunction(m_afs[i]);
     }
 
+    if(m_softmax) {
+        m_network.outLayer()->setActivationFunction(Neuropia::softmaxFunction);
+    }
+
     m_network.initialize(m_initStrategy);
+    m_network.setOptimizer(m_optimizer);
+
+    for(auto i = 0U; i < m_freeze.size(); i++) {
+        if(m_freeze[i] != 0) {
+            auto npt = m_network.get(static_cast<int>(i + 1)); // input layer has nothing to freeze
+            neuropia_assert_always(npt, "Too many items in list");
+            npt->freeze(true);
+        }
+    }
+
+    if(m_freezeCache && m_network.frozenLayer() != nullptr) {
+        m_frozenCache = std::make_unique<FrozenCache>();
+    }
+
+    m_heldOut = 0;
+    if(m_testVerifyFrequency > 0 && m_testVerifyFrequency <= m_iterations) {
+        if(m_holdOut) {
+            // the last samples of the training data are validated and not trained, test data is not used to select the model
+            if(m_validationSize == 0 || m_validationSize >= m_images.size()) {
+                std::cerr << "Invalid ValidationSize, expected less than " << m_images.size() << " samples" << std::endl;
+                return false;
+            }
+            m_heldOut = m_validationSize;
+        }
+        m_validator = std::make_unique<Validator>(m_validationImageFile, m_validationLabelFile, m_validationSize, m_holdOut ? trainingSize() : 0);
+        if(!m_validator->ok()) {
+            return false;
+        }
+    } else if(m_earlyStopPatience > 0 || m_targetAccuracy > 0.0) {
+        std::cerr << "Early stopping requires TestFrequency less than Iterations" << std::endl;
+        return false;
+    }
+
     setDropout();
     return true;
 }
 
+bool TrainerBase::trainSample(Neuropia::Layer& network, size_t sample, const std::vector<NeuronType>& inputs, const std::vector<NeuronType>& outputs, NeuronType learningRateScale) {
+#ifndef STD_ALLOCATOR
+    const MatrixArena::Scope arena(m_arena); // step temporaries are released at once
+#endif
+    const auto learningRate = m_learningRate * learningRateScale;
+    if(!m_frozenCache) {
+        const auto& out = [&]() -> const ValueVector& {
+            const auto scope = m_profiler.scope(Profiler::Phase::Forward);
+            return network.trainForward(inputs.begin());
+        }();
+        const auto scope = m_profiler.scope(Profiler::Phase::Backward);
+        return network.trainBackward(out, outputs.begin(), learningRate, m_lambdaL2);
+    }
+    auto activations = m_frozenCache->get(sample);
+    const auto cached = !activations.empty();
+    const auto& out = [&]() -> const ValueVector& {
+        const auto scope = m_profiler.scope(Profiler::Phase::Forward);
+        return network.trainForward(inputs.begin(), activations);
+    }();
+    if(!cached) {
+        m_frozenCache->set(sample, activations);
+    }
+    const auto scope = m_profiler.scope(Profiler::Phase::Backward);
+    return network.trainBackward(out, outputs.begin(), learningRate, m_lambdaL2);
+}
+
+ValueVector FrozenCache::get(size_t sample) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_activations.find(sample);
+    return it != m_activations.end() ? it->second : ValueVector{};
+}
+
+void FrozenCache::set(size_t sample, const ValueVector& activations) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_activations.emplace(sample, activations);
+}
+
+bool TrainerBase::testVerify(size_t iteration, const Neuropia::Layer& network) {
+    if(!m_validator)
+        return true;
+    if(m_validation.valid() && m_validation.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        testVerifyResult();
+    }
+    if(m_stop) {
+        std::cout << std::endl << "Early stop at iteration " << iteration << std::endl;
+        return false;
+    }
+    // if the previous is still running, this one is skipped
+    if((iteration + 1) % m_testVerifyFrequency == 0 && !m_validation.valid()) {
+        NEUROPIA_TRACE("snapshot");
+        const auto scope = m_profiler.scope(Profiler::Phase::Verify);
+        m_snapshot = std::make_shared<const Layer>(network.inferenceCopy());
+        m_snapshotTime = std::chrono::high_resolution_clock::now();
+        m_validation = m_validator->validateAsync(m_snapshot);
+    }
+    return true;
+}
+
+void TrainerBase::testVerifyResult() {
+    if(!m_validation.valid())
+        return;
+    const auto result = m_validation.get();
+    printVerify({result.found, result.count}, "Test");
+    if(m_earlyStopPatience == 0 && m_targetAccuracy <= 0.0)
+        return;
+    const auto score = m_earlyStopLoss ? -result.loss : result.accuracy();
+    if(!m_best || score > m_bestScore + m_earlyStopDelta) {
+        m_best = m_snapshot;
+        m_bestScore = score;
+        m_noImprovement = 0;
+    } else if(m_earlyStopPatience > 0 && ++m_noImprovement >= m_earlyStopPatience) {
+        m_stop = true;
+    }
+    if(m_targetAccuracy > 0.0 && result.accuracy() >= m_targetAccuracy) {
+        if(!m_targetReached) {
+            m_targetReached = m_snapshotTime;
+        }
+        if(m_best != m_snapshot) {
+            m_best = m_snapshot;
+            m_bestScore = score;
+        }
+        m_stop = true;
+    }
+}
+
+void TrainerBase::trainingEnd() {
+    if(m_validator) {
+        NEUROPIA_TRACE("training end");
+        const auto scope = m_profiler.scope(Profiler::Phase::Verify);
+        testVerifyResult();
+        if(m_best) {
+            const auto result = m_validator->validate(m_network);
+            const auto score = m_earlyStopLoss ? -result.loss : result.accuracy();
+            if(m_bestScore > score) {
+                m_network = *m_best;
+                std::cout << "Best validated network restored" << std::endl;
+            }
+            m_best.reset();
+        }
+    }
+    if(m_profiler.isEnabled()) {
+        std::cout << Profiler::report(m_profiler.stats());
+#ifndef STD_ALLOCATOR
+        const auto pool = MatrixAllocatorBase::stats();
+        std::ostringstream out;
+        out << "matrix pool hit rate:" << std::fixed << std::setprecision(1) << 100.0 * pool.hitRate() << "% held:" << pool.held
+            << " peak:" << pool.peak << " remote frees:" << pool.remoteFrees;
+        if(m_arena) {
+            out << " arena step peak:" << MatrixArena::peak();
+        }
+        std::cout << out.str() << std::endl;
+#endif
+    }
+#ifndef STD_ALLOCATOR
+    MatrixAllocator<NeuronType>::trim(); // worker pools are freed as their threads end
+#endif
+}
+
 bool TrainerBase::isReady() const {
     return m_images.ok() && m_labels.ok() && m_network.size() > 0 && m_passedIterations < m_iterations;
 }
 
 void TrainerBase::setDropout() {
     if(!m_dropoutRate.empty()) {
-        m_network.dropout(m_dropoutRate[0], true);
+        // cached activations are fed once per sample, hence the input and the layers up to the topmost frozen
+        // are not dropped out, else the dropout mask of the first feed would be cached and reused
+        auto cached = 0;
+        if(m_frozenCache) {
+            for(auto layer = m_network.frozenLayer(); layer != nullptr; layer = layer->get(-1))
+                ++cached;
+        }
+        if(auto first = m_network.get(cached)) {
+            first->dropout(m_dropoutRate[0], true);
+        }
+        // rates are given per layer of the topology, a linear layer inserted by factorization has no rate of its own
+        auto npt = &m_network;
+        auto depth = 0;
         for(auto i = 1U; i < m_dropoutRate.size(); i++) {
-            auto npt = m_network.get(static_cast<int>(i));
-            neuropia_assert_always(npt, "Too many items in list");
-            npt->dropout(m_dropoutRate[i], false);
+            do {
+                npt = npt->get(1);
+                ++depth;
+                neuropia_assert_always(npt, "Too many items in list");
+            } while(npt->activationFunction() == Neuropia::linearFunction);
+            if(depth >= cached) {
+                npt->dropout(m_dropoutRate[i], false);
+            }
         }
     }
 }
 
 bool TrainerBase::train() {
+    return trainStep() && factorizeTrain() && pruneTrain();
+}
+
+bool TrainerBase::trainStep() {
     if(m_images.size() == 0) {
         std::cerr << "train has not initialized" << std::endl;
         return false;
@@ -217,7 +451,59 @@ bool TrainerBase::train() {
             std::cerr << m_classes << std::endl;
             return false;
         }      
+    if(m_prune < 0.0 || m_prune >= 1.0) {
+        std::cerr << "Invalid Prune" << std::endl;
+        return false;
+    }
+    if(m_rank > static_cast<unsigned>(m_topology.front())) {
+        std::cerr << "Invalid Rank, expected at most " << m_topology.front() << std::endl;
+        return false;
+    }
     return doTrain();
 }
 
+void TrainerBase::restart(unsigned iterations) {
+    m_iterations = iterations > 0 ? iterations : m_iterations;
+    m_passedIterations = 0;
+    m_learningRate = m_learningRateMax;
+    m_start = std::chrono::high_resolution_clock::now();
+    m_gap = 0;
+    m_best.reset();
+    m_noImprovement = 0;
+    m_stop = false;
+    setDropout(); // the previous training ended by inversing the dropout
+}
+
+bool TrainerBase::factorizeTrain() {
+    if(m_rank == 0) {
+        return true;
+    }
+    m_network.get(1)->factorize(m_rank);
+    std::cout << "Factorized to rank " << m_rank << std::endl;
+    restart(m_rankIterations);
+    return doTrain();
+}
+
+bool TrainerBase::pruneTrain() {
+    if(m_prune <= 0.0) {
+        return true;
+    }
+    if(m_pruneCycles == 0) {
+        m_network.prune(m_prune);
+        return true;
+    }
+    // sparsity is raised gradually, and the remaining weights are fine-tuned to recover after each step
+    for(auto cycle = 1U; cycle <= m_pruneCycles; cycle++) {
+        const auto sparsity = m_prune * static_cast<NeuronType>(cycle) / static_cast<NeuronType>(m_pruneCycles);
+        m_network.prune(sparsity);
+        std::cout << "Prune cycle " << cycle << "/" << m_pruneCycles << " sparsity:" << sparsity << std::endl;
+        restart(m_pruneIterations);
+        if(!doTrain()) {
+            return false;
+        }
+        m_network.compress();
+    }
+    return true;
+}
+
 
@@ -126,7 +126,7 @@ void Neuropia::debug(const Neuropia::Layer& layer, std::ostream& out, const std:
                 for(auto i = 0U; i < n.size(); i++)
                     avg += n.weight_d(i);
                 avg /= static_cast<NeuronType>(n.size());
-                out << "layer " << count << ", neuron:" << neuron << ", weights avg:"<< avg << ", bias:" << n.bias() << ", function:" << l->activationFunction().name() << ", active:" << n.isActive() << std::endl;
+                out << "layer " << count << ", neuron:" << neuron << ", weights avg:"<< avg << ", bias:" << n.bias() << ", function:" << l->activationFunction().name() << ", active:" << (n.isActive() && !l->isDropped(static_cast<size_t>(neuron - 1))) << std::endl;
             }
         }
         l = l->get(1);
@@ -138,19 +138,14 @@ std::string Neuropia::absPath(const std::string& root, const std::string& relati
         relativePath : root + "/" + relativePath;
 }
 
-Random::Random(unsigned seed) : m_gen(seed) {}
+Random::Random(unsigned seed) : m_gen(seed, static_cast<uint64_t>(Philox::Stream::Sampling) << 48) {}
 
-Random::Random() : m_gen(
-#ifndef RANDOM_SEED
-    static_cast<unsigned>(std::chrono::system_clock::now().time_since_epoch().count())
-#else
-    RANDOM_SEED
-#endif
-) {}
+Random::Random() : m_gen(Philox::stream(Philox::Stream::Sampling, Philox::run(), 0)) {}
 
 size_t Random::random(size_t atop) {
     neuropia_assert(atop > 0);
-    return (m_gen() % atop);
+    const auto high = static_cast<uint64_t>(m_gen()) << 32;
+    return static_cast<size_t>((high | m_gen()) % atop);
     }
 
 std::string_view Neuropia::to_string(Neuropia::SaveType st) {
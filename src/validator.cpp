@@ -0,0 +1,82 @@
+#include "validator.h"
+#include "idxreader.h"
+#include "trace.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+using namespace Neuropia;
+
+Validator::Validator(const std::string& imageFile, const std::string& labelFile, size_t count, size_t first) {
+    Neuropia::IdxReader<unsigned char> images(imageFile);
+    Neuropia::IdxReader<unsigned char> labels(labelFile);
+
+    if(!images.ok()) {
+        std::cerr << "Cannot open images from \"" << imageFile << "\"" << std::endl;
+        return;
+    }
+
+    if(!labels.ok()) {
+         std::cerr << "Cannot open labels from \"" << labelFile << "\"" << std::endl;
+         return;
+    }
+
+    m_inputSize = images.size(1) * images.size(2);
+    const auto available = std::min(images.size(), labels.size());
+    const auto sz = first < available ? std::min(count, available - first) : 0;
+    m_inputs.resize(sz * m_inputSize);
+    m_labels.resize(sz);
+    for(auto i = 0U; i < sz; i++) {
+        const auto image = images.readAt(first + i, m_inputSize);
+        std::copy(image.begin(), image.end(), m_inputs.begin() + static_cast<long>(i * m_inputSize));
+        m_labels[i] = static_cast<unsigned>(labels.readAt(first + i));
+    }
+}
+
+Validation Validator::validate(const Layer& network) const {
+    NEUROPIA_TRACE("validate");
+    Validation result;
+    // softmax is trained with cross-entropy, hence its loss is that
+    const auto crossEntropy = network.outLayer()->activationFunction() == softmaxFunction;
+    for(auto i = 0U; i < m_labels.size(); i++) {
+        const auto begin = m_inputs.begin() + static_cast<long>(i * m_inputSize);
+        const auto& outputs = network.feed(begin, begin + static_cast<long>(m_inputSize), ByteScale);
+        const auto max = static_cast<unsigned>(std::distance(outputs.begin(),
+                                             std::max_element(outputs.begin(), outputs.end())));
+        if(max == m_labels[i]) {
+            ++result.found;
+        }
+        NeuronType loss = 0;
+        if(crossEntropy) {
+            const auto p = m_labels[i] < outputs.size() ? outputs[m_labels[i]] : 0;
+            loss = -std::log(std::max(p, std::numeric_limits<NeuronType>::min()));
+        } else {
+            for(auto j = 0U; j < outputs.size(); j++) {
+                const auto e = (j == m_labels[i] ? 1.0 : 0.0) - outputs[j];
+                loss += e * e;
+            }
+        }
+        result.loss += loss;
+    }
+    result.count = static_cast<unsigned>(m_labels.size());
+    if(result.count > 0) {
+        result.loss /= static_cast<NeuronType>(result.count);
+    }
+    return result;
+}
+
+std::future<Validation> Validator::validateAsync(const Layer& network) const {
+    return validateAsync(std::make_shared<const Layer>(network.inferenceCopy()));
+}
+
+std::future<Validation> Validator::validateAsync(const std::shared_ptr<const Layer>& network) const {
+#ifdef __EMSCRIPTEN__  // no threads, validated synchronously
+    std::promise<Validation> promise;
+    promise.set_value(validate(*network));
+    return promise.get_future();
+#else
+    return std::async(std::launch::async, [this, network]() {
+        return validate(*network);
+    });
+#endif
+}
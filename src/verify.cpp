@@ -1,6 +1,8 @@
 #include "verify.h"
 #include "utils.h"
+#include "trace.h"
 #include <map>
+#include <cmath>
 
 using namespace Neuropia;
 
@@ -11,6 +13,7 @@ std::tuple<int, unsigned> Neuropia::verify(const Neuropia::Layer& network,
                  bool quiet,
                  size_t from,
                  size_t count) {
+    NEUROPIA_TRACE("verify");
     Neuropia::IdxReader<unsigned char> testImages(imageFile);
     Neuropia::IdxReader<unsigned char> testLabels(labelFile);
 
@@ -27,16 +30,12 @@ std::tuple<int, unsigned> Neuropia::verify(const Neuropia::Layer& network,
     int found = 0;
     Neuropia::timed([&]() {
         const auto imageSize = testImages.size(1) * testImages.size(2);
-        std::vector<Neuropia::NeuronType> inputs(imageSize);
         const auto iterations = std::min(count, testLabels.size());
         for(auto i = from; i < iterations; i++) {
             const auto image = testImages.read(imageSize);
             const auto label = static_cast<unsigned>(testLabels.read());
 
-            std::transform(image.begin(), image.end(), inputs.begin(), [](unsigned char c) {
-                return Neuropia::normalize(static_cast<Neuropia::NeuronType>(c), 0, 255);
-            });
-            const auto& outputs = network.feed(inputs.begin(), inputs.end());
+            const auto& outputs = network.feed(image.begin(), image.end(), Neuropia::ByteScale);
             const auto max = static_cast<unsigned>(std::distance(outputs.begin(),
                                                  std::max_element(outputs.begin(), outputs.end())));
 
@@ -83,20 +82,15 @@ std::tuple<int, unsigned> Neuropia::verifyEnseble(const std::vector<Neuropia::La
     const auto imageSize = testImages.size(1) * testImages.size(2);
     int found = 0;
     Neuropia::timed([&]() {
-        std::vector<Neuropia::NeuronType> inputs(imageSize);
         const auto iterations = std::min(count, testLabels.size());
         for(auto i = from; i < iterations; i++) {
             const auto image = testImages.read(imageSize);
             const size_t label = testLabels.read();
 
-            std::transform(image.begin(), image.end(), inputs.begin(), [](auto c) {
-                return Neuropia::normalize(static_cast<Neuropia::NeuronType>(c), 0, 255);
-            });
-
             std::map<unsigned, size_t> hardVotes; //hard we take one got most of outputs for each round
             std::map<size_t, NeuronType> softVotes;   //we sum up the results and take one get more over all results in round
             for(const auto& network : ensebles) {
-                const auto& outputs = network.feed(inputs.begin(), inputs.end());
+                const auto& outputs = network.feed(image.begin(), image.end(), Neuropia::ByteScale);
 
                 if(hard) {
                     const auto result = static_cast<unsigned>(std::distance(outputs.begin(),
@@ -133,3 +127,41 @@ std::tuple<int, unsigned> Neuropia::verifyEnseble(const std::vector<Neuropia::La
 
     return std::make_tuple(found, static_cast<unsigned>(std::min(count, testLabels.size()) - from));
 }
+
+std::vector<std::vector<Neuropia::NeuronStats>> Neuropia::activationStats(const Neuropia::Layer& network, const std::string& imageFile, size_t count) {
+    Neuropia::IdxReader<unsigned char> images(imageFile);
+    if(!images.ok()) {
+        std::cerr << "Cannot open images from \"" << imageFile << "\"" << std::endl;
+        return {};
+    }
+    // Welford's running mean and sum of squared differences
+    std::vector<Neuropia::ValueVector> means;
+    std::vector<Neuropia::ValueVector> squares;
+    for(auto layer = network.next(); layer != nullptr; layer = layer->next()) {
+        means.emplace_back(layer->size(), 0);
+        squares.emplace_back(layer->size(), 0);
+    }
+    const auto imageSize = images.size(1) * images.size(2);
+    const auto iterations = std::min(count, images.size());
+    for(size_t i = 0; i < iterations; i++) {
+        const auto image = images.read(imageSize);
+        network.feed(image.begin(), image.end(), Neuropia::ByteScale);
+        auto l = 0U;
+        for(auto layer = network.next(); layer != nullptr; layer = layer->next(), l++) {
+            const auto& outputs = layer->outputs();
+            for(auto j = 0U; j < layer->size(); j++) {
+                const auto delta = outputs[j] - means[l][j];
+                means[l][j] += delta / static_cast<Neuropia::NeuronType>(i + 1);
+                squares[l][j] += delta * (outputs[j] - means[l][j]);
+            }
+        }
+    }
+    std::vector<std::vector<Neuropia::NeuronStats>> stats(means.size());
+    for(auto l = 0U; l < means.size(); l++) {
+        for(auto j = 0U; j < means[l].size(); j++) {
+            const auto variance = iterations > 0 ? squares[l][j] / static_cast<Neuropia::NeuronType>(iterations) : 0;
+            stats[l].push_back({means[l][j], std::sqrt(variance)});
+        }
+    }
+    return stats;
+}
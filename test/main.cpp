@@ -20,6 +20,11 @@
 #include "../neuropialib/neuropialib.h"
 
 extern void testLogicalPorts();
+extern void testFreeze();
+extern void testSeed();
+extern void testPrune();
+extern void testFactorize();
+extern void testBinary();
 
 int main(int argc, char* argv[]) {
 
@@ -39,6 +44,26 @@ int main(int argc, char* argv[]) {
                 testLogicalPorts();
                 std::cout << std::endl;
             }
+    },{
+            "freeze", [](const std::string&) {
+                testFreeze();
+            }
+    },{
+            "seed", [](const std::string&) {
+                testSeed();
+            }
+    },{
+            "prune", [](const std::string&) {
+                testPrune();
+            }
+    },{
+            "factorize", [](const std::string&) {
+                testFactorize();
+            }
+    },{
+            "binary", [](const std::string&) {
+                testBinary();
+            }
     },{
             "trainMnist", [&](const std::string & root) {
                 Neuropia::Trainer trainer(root, params, quiet);
@@ -188,6 +213,7 @@ int main(int argc, char* argv[]) {
         params.addHelp( topologyRe, "\',\'-separated list of integers");
         params.addHelp( activationFunctionRe, "\',\'-separated list of activation functions: \"sigmoid, relu or elu\"");
         params.addHelp( dropoutRateRe, "\',\'-separated of list of real numbers");
+        params.addHelp( freezeRe, "\',\'-separated list of 0 or 1 per layer, starting from the first hidden layer");
         for(const auto& p :  params) {
             std::cerr  << std::get<0>(p) <<  ", default:\"" << std::get<1>(p) << "\" assuming: \"" << params.toType(std::get<2>(p)) << "\"" << std::endl;
         }
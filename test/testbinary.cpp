@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <iterator>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "neuropia.h"
+#include "neuropia_binary.h"
+#include "utils.h"
+
+// weights of a neuron are +scale or -scale, and the bias is not a multiple of the scale, hence the binarized
+// network computes the same sums and no sum is at an activation threshold
+static
+Neuropia::Layer* signLayer(size_t inputs, size_t neurons, const Neuropia::ActivationFunction& af, std::default_random_engine& gen) {
+    std::uniform_real_distribution<Neuropia::NeuronType> scales(0.1, 1.0);
+    std::uniform_int_distribution<int> steps(-3, 3);
+    auto layer = new Neuropia::Layer(0, af);
+    for(auto n = 0U; n < neurons; n++) {
+        const auto scale = scales(gen);
+        Neuropia::ValueVector weights(inputs);
+        for(auto& w : weights)
+            w = gen() % 2 == 0 ? scale : -scale;
+        layer->append(Neuropia::Neuron(af, weights, scale * (static_cast<Neuropia::NeuronType>(steps(gen)) + 0.5)));
+    }
+    return layer;
+}
+
+static
+size_t argmax(const Neuropia::ValueVector& values) {
+    return static_cast<size_t>(std::distance(values.begin(), std::max_element(values.begin(), values.end())));
+}
+
+static
+size_t argmax(const std::vector<float>& values) {
+    return static_cast<size_t>(std::distance(values.begin(), std::max_element(values.begin(), values.end())));
+}
+
+// a binarized network classifies as the network it is converted from when the network is sign exact,
+// it is saved and loaded as it was, and the popcount kernels give the same counts as the default one
+void testBinary();
+void testBinary() {
+    std::default_random_engine gen(7);
+    constexpr size_t inputSize = 70; // more than two words
+    auto network = Neuropia::Layer(inputSize);
+    network.join(signLayer(inputSize, 40, Neuropia::signumFunction, gen));
+    network.join(signLayer(40, 33, Neuropia::signumFunction, gen));
+    network.join(signLayer(33, 10, Neuropia::sigmoidFunction, gen));
+
+    const auto binary = Neuropia::BinaryNetwork::convert(network);
+    neuropia_assert_always(binary, "network cannot be binarized");
+
+    const std::string file = "binary_test.neub";
+    const auto saved = binary->save(file);
+    std::ifstream strm(file, std::ios::in | std::ios::binary);
+    const std::vector<uint8_t> data((std::istreambuf_iterator<char>(strm)), std::istreambuf_iterator<char>());
+    strm.close();
+    std::remove(file.c_str());
+    const auto loaded = Neuropia::BinaryNetwork::load(data.data(), data.size());
+
+    auto agree = 0U;
+    auto same = saved && loaded.has_value();
+    constexpr auto samples = 200U;
+    for(auto s = 0U; s < samples; s++) {
+        std::vector<uint8_t> bytes(inputSize);
+        Neuropia::ValueVector values(inputSize);
+        for(auto i = 0U; i < inputSize; i++) {
+            bytes[i] = gen() % 2 == 0 ? 0 : 255;
+            values[i] = bytes[i] == 0 ? 0 : 1;
+        }
+        const auto expected = argmax(network.feed(values.begin(), values.end()));
+        const auto outputs = binary->feed(bytes.begin(), bytes.end());
+        if(argmax(outputs) == expected)
+            ++agree;
+        same = same && loaded->feed(bytes.begin(), bytes.end()) == outputs;
+    }
+
+    // counts of every layer on random bits, having unused bits zero
+    auto counts = true;
+    for(const auto& layer : binary->layers()) {
+        std::vector<uint32_t> bits(layer.words(), 0);
+        int setBits = 0;
+        for(auto i = 0U; i < layer.inputs; i++) {
+            const auto bit = static_cast<uint32_t>(gen() % 2);
+            bits[i / Neuropia::BinaryNetwork::WordBits] |= bit << (i % Neuropia::BinaryNetwork::WordBits);
+            setBits += static_cast<int>(bit);
+        }
+        std::vector<int> reference(layer.neurons);
+        Neuropia::BinaryNetwork::dots(layer, bits.data(), setBits, reference.data(), Neuropia::BinaryNetwork::Kernel::Default);
+        for(const auto kernel : {Neuropia::BinaryNetwork::Kernel::Auto, Neuropia::BinaryNetwork::Kernel::Popcnt, Neuropia::BinaryNetwork::Kernel::Vpopcnt}) {
+            if(Neuropia::BinaryNetwork::supports(kernel)) {
+                std::vector<int> result(layer.neurons);
+                Neuropia::BinaryNetwork::dots(layer, bits.data(), setBits, result.data(), kernel);
+                counts = counts && result == reference;
+            }
+        }
+    }
+
+    std::cout << "binary agrees " << agree << "/" << samples
+              << ", save and load " << (same ? "equal" : "differ")
+              << ", kernel counts " << (counts ? "equal" : "differ")
+              << (Neuropia::BinaryNetwork::supports(Neuropia::BinaryNetwork::Kernel::Popcnt) ? "" : " (popcnt not supported)") << std::endl;
+    neuropia_assert_always(agree == samples, "binarized network classifies differently");
+    neuropia_assert_always(same, "loaded binarized network differs");
+    neuropia_assert_always(counts, "kernel counts differ");
+}
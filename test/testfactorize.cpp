@@ -0,0 +1,62 @@
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include "neuropia.h"
+#include "utils.h"
+
+static
+bool near(const Neuropia::ValueVector& a, const Neuropia::ValueVector& b, Neuropia::NeuronType tolerance) {
+    if(a.size() != b.size())
+        return false;
+    for(size_t i = 0; i < a.size(); i++) {
+        if(std::abs(a[i] - b[i]) > tolerance)
+            return false;
+    }
+    return true;
+}
+
+static
+size_t layers(const Neuropia::Layer& network) {
+    size_t count = 0;
+    for(auto layer = &network; layer != nullptr; layer = layer->get(1))
+        ++count;
+    return count;
+}
+
+// a full rank factorization feeds as the original, a lower rank inserts a linear layer, and both save and load
+void testFactorize();
+void testFactorize() {
+    auto network = Neuropia::Layer(12);
+    network.join(8);  // more inputs than neurons
+    network.join(10); // more neurons than inputs
+    network.join(4);
+    network.randomize();
+    const Neuropia::ValueVector inputs = {0.1, 0.9, 0.5, 0.3, 0.0, 0.7, 1.0, 0.2, 0.4, 0.0, 0.6, 0.8};
+    const auto outputs = network.feed(inputs.begin(), inputs.end());
+
+    auto full = network;
+    full.get(1)->factorize(8);
+    full.get(3)->factorize(8);
+    const auto exact = layers(full) == layers(network) + 2 && near(full.feed(inputs.begin(), inputs.end()), outputs, 1e-4);
+
+    auto low = network;
+    const auto& inserted = low.get(1)->factorize(3);
+    const auto lowOutputs = low.feed(inputs.begin(), inputs.end());
+    const auto linear = low.get(1) == &inserted && inserted.size() == 3 && inserted.activationFunction() == Neuropia::linearFunction
+        && low.get(2)->size() == 8 && (*low.get(2))[0].size() == 3;
+
+    const std::string file = "factorize_test.bin";
+    Neuropia::save(file, low, {});
+    const auto loaded = Neuropia::load(file);
+    std::remove(file.c_str());
+    const auto roundtrip = loaded && std::get<0>(*loaded).get(1)->activationFunction() == Neuropia::linearFunction
+        && std::get<0>(*loaded).feed(inputs.begin(), inputs.end()) == lowOutputs;
+
+    std::cout << "factorize full rank " << (exact ? "equal" : "differs")
+              << ", lower rank " << (linear ? "inserts a linear layer" : "does not insert a linear layer")
+              << ", save and load " << (roundtrip ? "equal" : "differ") << std::endl;
+    neuropia_assert_always(exact, "full rank factorization differs");
+    neuropia_assert_always(linear, "lower rank did not insert a linear layer");
+    neuropia_assert_always(roundtrip, "loaded factorized network differs");
+}
@@ -0,0 +1,41 @@
+#include <iostream>
+#include "neuropia.h"
+#include "utils.h"
+
+// weights of a frozen layer are not changed by training with dropout, nor when the dropout is inversed
+void testFreeze();
+void testFreeze() {
+    auto network = Neuropia::Layer(4);
+    network.join(8);
+    network.join(6);
+    network.join(2);
+    network.randomize();
+    network.get(1)->freeze(true);
+    network.dropout(0.5);
+    const auto before = network;
+
+    const Neuropia::ValueVector inputs = {0.1, 0.9, 0.5, 0.3};
+    const Neuropia::ValueVector expected = {1, 0};
+    for(auto i = 0; i < 1000; i++) {
+        network.train(inputs.begin(), expected.begin(), 0.05, 0.0);
+    }
+    network.inverseDropout();
+
+    const auto unchanged = [&](int index) {
+        const auto& layer = *network.get(index);
+        const auto& reference = *before.get(index);
+        for(size_t n = 0; n < layer.size(); n++) {
+            if(layer[n].bias() != reference[n].bias())
+                return false;
+            for(size_t w = 0; w < layer[n].size(); w++) {
+                if(layer[n].weight(w) != reference[n].weight(w))
+                    return false;
+            }
+        }
+        return true;
+    };
+    const auto frozen = unchanged(1);
+    std::cout << "freeze frozen layer " << (frozen ? "unchanged" : "changed")
+              << ", trained layer " << (unchanged(2) ? "unchanged" : "changed") << std::endl;
+    neuropia_assert_always(frozen, "frozen layer changed");
+}
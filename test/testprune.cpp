@@ -0,0 +1,73 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "neuropia.h"
+#include "utils.h"
+
+static
+std::vector<Neuropia::NeuronType> sparsities(const Neuropia::Layer& network) {
+    std::vector<Neuropia::NeuronType> values;
+    for(auto layer = network.get(1); layer != nullptr; layer = layer->get(1))
+        values.push_back(layer->sparsity());
+    return values;
+}
+
+static
+std::vector<bool> zeros(const Neuropia::Layer& network) {
+    std::vector<bool> values;
+    for(auto layer = network.get(1); layer != nullptr; layer = layer->get(1)) {
+        for(const auto& n : *layer) {
+            for(size_t w = 0; w < n.size(); w++)
+                values.push_back(n.weight(w) == 0);
+        }
+    }
+    return values;
+}
+
+// a pruned network is saved as NEU00006 and loaded as it was, and its pruned weights stay zero in training
+void testPrune();
+void testPrune() {
+    constexpr Neuropia::NeuronType target = 0.8;
+    auto network = Neuropia::Layer(16);
+    network.join(32);
+    network.join(4);
+    network.randomize();
+    network.prune(target);
+
+    auto sparse = true;
+    for(const auto s : sparsities(network))
+        sparse = sparse && s >= target - 0.01;
+
+    const Neuropia::ValueVector inputs = {0.1, 0.9, 0.5, 0.3, 0.0, 0.7, 1.0, 0.2, 0.4, 0.0, 0.6, 0.8, 0.0, 0.3, 0.5, 0.9};
+    const auto outputs = network.feed(inputs.begin(), inputs.end());
+
+    const std::string file = "prune_test.bin";
+    Neuropia::save(file, network, {});
+    std::ifstream strm(file, std::ios::in | std::ios::binary);
+    std::string header(8, '\0');
+    strm.read(&header[0], static_cast<std::streamsize>(header.size()));
+    strm.close();
+    const auto loaded = Neuropia::load(file);
+    std::remove(file.c_str());
+    const auto roundtrip = header == "NEU00006" && loaded && sparsities(std::get<0>(*loaded)) == sparsities(network)
+        && std::get<0>(*loaded).feed(inputs.begin(), inputs.end()) == outputs;
+
+    const auto pruned = zeros(network);
+    const Neuropia::ValueVector expected = {1, 0, 0, 0};
+    for(auto i = 0; i < 200; i++) {
+        network.train(inputs.begin(), expected.begin(), 0.05, 0.0);
+    }
+    const auto trained = zeros(network);
+    auto kept = true;
+    for(size_t i = 0; i < pruned.size(); i++)
+        kept = kept && (!pruned[i] || trained[i]);
+
+    std::cout << "prune sparsity " << (sparse ? "reached" : "not reached")
+              << ", save and load " << (roundtrip ? "equal" : "differ")
+              << ", pruned weights " << (kept ? "kept zero" : "changed") << " in training" << std::endl;
+    neuropia_assert_always(sparse, "sparsity not reached");
+    neuropia_assert_always(roundtrip, "loaded pruned network differs");
+    neuropia_assert_always(kept, "pruned weights changed in training");
+}
@@ -0,0 +1,71 @@
+#include <array>
+#include <iostream>
+#include <vector>
+#include "neuropia.h"
+#include "philox.h"
+#include "utils.h"
+
+static
+bool equal(const Neuropia::Layer& a, const Neuropia::Layer& b) {
+    for(auto l = &a, r = &b; l != nullptr && r != nullptr; l = l->get(1), r = r->get(1)) {
+        for(size_t n = 0; n < l->size(); n++) {
+            if((*l)[n].bias() != (*r)[n].bias())
+                return false;
+            for(size_t w = 0; w < (*l)[n].size(); w++) {
+                if((*l)[n].weight(w) != (*r)[n].weight(w))
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+static
+Neuropia::Layer newNetwork(bool randomize) {
+    auto network = Neuropia::Layer(4);
+    network.join(8);
+    network.join(2);
+    if(randomize)
+        network.randomize();
+    else
+        network.initialize(Neuropia::Layer::InitStrategy::Logistic);
+    return network;
+}
+
+static
+std::vector<size_t> samples() {
+    Neuropia::Random random;
+    std::vector<size_t> indices(16);
+    for(auto& i : indices)
+        i = random.random(60000);
+    return indices;
+}
+
+// Philox4x32-10 known answers of Random123, networks and samplings of a process differ, and a seed reproduces them
+void testSeed();
+void testSeed() {
+    using Block = std::array<uint32_t, 4>;
+    const auto zero = Neuropia::Philox::block({0, 0, 0, 0}, {0, 0});
+    const auto ones = Neuropia::Philox::block({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff});
+    const auto pi = Neuropia::Philox::block({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0});
+    const auto known = zero == Block{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8} &&
+        ones == Block{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd} &&
+        pi == Block{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1};
+
+    const auto differ = !equal(newNetwork(true), newNetwork(true)) && !equal(newNetwork(false), newNetwork(false)) &&
+        samples() != samples();
+
+    Neuropia::Philox::setSeed(42);
+    const auto randomized = newNetwork(true);
+    const auto initialized = newNetwork(false);
+    const auto sampled = samples();
+    Neuropia::Philox::setSeed(42);
+    const auto reproduced = equal(randomized, newNetwork(true)) && equal(initialized, newNetwork(false)) && sampled == samples();
+
+    std::cout << "seed known answers " << (known ? "match" : "differ")
+              << ", networks and samplings of a process " << (differ ? "differ" : "are equal")
+              << ", seeded runs " << (reproduced ? "reproduced" : "differ") << std::endl;
+    neuropia_assert_always(known, "Philox known answers differ");
+    neuropia_assert_always(differ, "networks or samplings of a process are equal");
+    neuropia_assert_always(reproduced, "seeded runs differ");
+}
@@ -0,0 +1,55 @@
+import sys
+import json
+import argparse
+
+# metric name and True if higher is better
+METRICS = [('samples_per_sec', True), ('time_to_target', False), ('peak_rss_kb', False),
+           ('ns_per_op', False), ('bytes_per_op', False), ('allocs_per_op', False),
+           ('ipc', True), ('cache_misses_per_op', False), ('branch_misses_per_op', False)]
+
+
+def load(file_name):
+    with open(file_name) as f:
+        return {case['name']: case for case in json.load(f)['cases']}
+
+
+def change(base, current, higher_is_better):
+    # positive is improvement, negative regression, in percents
+    if base is None or current is None or base == 0:
+        return None
+    return ((current - base) if higher_is_better else (base - current)) / base * 100.0
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Compare neuropia_bench or neuropia_microbench results against a baseline')
+    parser.add_argument('baseline')
+    parser.add_argument('current')
+    parser.add_argument('--threshold', type=float, default=5.0, help='allowed regression in percents')
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    regressions = 0
+    for name, case in current.items():
+        if name not in baseline:
+            print('{:<24} new'.format(name))
+            continue
+        base = baseline[name]
+        for metric, higher_is_better in METRICS:
+            b = base.get(metric)
+            c = case.get(metric)
+            if b is not None and c is None and metric == 'time_to_target':
+                print('{:<24} {:<16} target not reached (was {:.3f})'.format(name, metric, b))
+                regressions += 1
+                continue
+            d = change(b, c, higher_is_better)
+            if d is None:
+                continue
+            regressed = d < -args.threshold
+            regressions += 1 if regressed else 0
+            print('{:<24} {:<16} {:>12.3f} -> {:>12.3f} {:+7.1f}%{}'.format(
+                name, metric, b, c, d, ' REGRESSION' if regressed else ''))
+    for name in baseline:
+        if name not in current:
+            print('{:<24} missing'.format(name))
+    sys.exit(1 if regressions > 0 else 0)
@@ -57,6 +57,14 @@ NeuropiaSimple::ParamMap basicParams(const WasmNeuropiaPtr& env) {
     p.erase("Jobs");    //mt
     p.erase("BatchSize"); //mt
     p.erase("BatchVerifySize"); //mt
+    p.erase("Population"); //mt
+    p.erase("Elite"); //mt
+    p.erase("LearningRateSpread"); //mt
+    p.erase("Rank"); //fine-tuned after training, not stepped
+    p.erase("RankIterations");
+    p.erase("Prune"); //pruned and fine-tuned after training, not stepped
+    p.erase("PruneCycles");
+    p.erase("PruneIterations");
     p.erase("Hard"); //for ensenble
     p.erase("Extra"); //this is for ensemble
     p.erase("LearningRate"); //use only min and max
@@ -18,12 +18,12 @@ bool SimpleTrainer::train(unsigned batchSize, SimpleLogStream& stream) {
     for(unsigned b = 0; b < std::min(m_iterations, batchSize); ++b) {
         ++m_passedIterations;
         
-        const auto success = TrainerBase::train();
+        const auto success = TrainerBase::trainStep();
     
 
         if(!success) {
             stream.freeze(false);
-            TrainerBase::train(); // to get error out
+            TrainerBase::trainStep(); // to get error out
             m_onEnd(network(), false);
             ok = false;
             break;
@@ -38,6 +38,7 @@ bool SimpleTrainer::train(unsigned batchSize, SimpleLogStream& stream) {
                         << "." <<  std::chrono::duration_cast<std::chrono::microseconds>(stop - m_start).count()
                         - std::chrono::duration_cast<std::chrono::seconds>(stop - m_start).count() * 1000000 << std::endl;
             m_network.inverseDropout();
+            trainingEnd();
             m_onEnd(network(), true);
             break;
             }
@@ -48,10 +49,8 @@ bool SimpleTrainer::train(unsigned batchSize, SimpleLogStream& stream) {
 
 
 bool SimpleTrainer::doTrain() {
-    auto testVerify = m_testVerifyFrequency;
-
     if(m_maxTrainTime >= MaxTrainTime) {
-        if(!m_quiet)
+        if(progress())
             percentage(m_passedIterations, m_iterations);
         m_learningRate += (1.0 / static_cast<NeuronType>(m_iterations)) * (m_learningRateMin - m_learningRateMax);
     } else {
@@ -62,15 +61,20 @@ bool SimpleTrainer::doTrain() {
         }
         const auto change = delta - m_gap;
         m_gap = delta;
-        if(!m_quiet)
+        if(progress())
             percentage(delta, m_maxTrainTime, " " + std::to_string(m_learningRate));
         this->m_learningRate += (static_cast<NeuronType>(change) / static_cast<NeuronType>(m_maxTrainTime)) * (m_learningRateMin - m_learningRateMax);
     }
 
     const auto imageSize = m_images.size(1) * m_images.size(2);
-    const auto at = m_random.random(m_images.size());
-    const auto image = m_images.readAt(at, imageSize);
-    const auto label = static_cast<unsigned>(m_labels.readAt(at));
+    const auto at = [&]() {
+        const auto scope = m_profiler.scope(Profiler::Phase::Sampling);
+        return m_random.random(trainingSize());
+    }();
+    const auto [image, label] = [&]() {
+        const auto scope = m_profiler.scope(Profiler::Phase::Io);
+        return std::make_tuple(m_images.readAt(at, imageSize), static_cast<unsigned>(m_labels.readAt(at)));
+    }();
 
 
 #ifdef DEBUG_SHOW
@@ -79,21 +83,21 @@ bool SimpleTrainer::doTrain() {
 #endif
 
     std::vector<Neuropia::NeuronType> inputs(imageSize);
-    std::transform(image.begin(), image.end(), inputs.begin(), [](unsigned char c) {
-        return Neuropia::normalize(static_cast<Neuropia::NeuronType>(c), 0, 255);
-    });
-
     std::vector<Neuropia::NeuronType> outputs(m_network.outLayer()->size());
-    outputs[label] = 1.0; //correct one is 1
-    if(!this->m_network.train(inputs.begin(), outputs.begin(), m_learningRate, m_lambdaL2)) {
+    {
+        const auto scope = m_profiler.scope(Profiler::Phase::Normalization);
+        std::transform(image.begin(), image.end(), inputs.begin(), [](unsigned char c) {
+            return Neuropia::normalize(static_cast<Neuropia::NeuronType>(c), 0, 255);
+        });
+        outputs[label] = 1.0; //correct one is 1
+    }
+    if(!trainSample(m_network, at, inputs, outputs)) {
         return false;
     }
+    ++m_trainedSamples;
 
-    if(--testVerify == 0) {
-        m_network.inverseDropout();
-        printVerify(Neuropia::verify(m_network, m_imageFile, m_labelFile, 0, 200), "Test");
-        setDropout();
-        testVerify = m_testVerifyFrequency;
+    if(!testVerify(m_passedIterations - 1, m_network)) {
+        m_passedIterations = m_iterations; // early stop, train ends as all iterations were done
     }
     return true;
 }
@@ -106,15 +110,9 @@ bool SimpleVerifier::verify() {
     const auto image = m_testImages.read(imageSize);
     const auto label = static_cast<unsigned>(m_testLabels.read());
 
-    std::vector<Neuropia::NeuronType> inputs(imageSize);
-
-    std::transform(image.begin(), image.end(), inputs.begin(), [](unsigned char c) {
-        return Neuropia::normalize(static_cast<Neuropia::NeuronType>(c), 0, 255);
-    });
-
     ASSERT_X(m_network.isValid(), std::string("On lap" + std::to_string(m_position)).c_str());
 
-    const auto& outputs = m_network.feed(inputs.begin(), inputs.end());
+    const auto& outputs = m_network.feed(image.begin(), image.end(), Neuropia::ByteScale);
     const auto max = static_cast<unsigned>(std::distance(outputs.begin(),
                                          std::max_element(outputs.begin(), outputs.end())));
 